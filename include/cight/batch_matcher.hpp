@@ -0,0 +1,144 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIGHT_BATCH_MATCHER_HPP
+#define CIGHT_BATCH_MATCHER_HPP
+
+#include <cight/interpolator.hpp>
+#include <cight/visual_matcher.hpp>
+
+#include <clarus/core/list.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+namespace cight {
+    struct BatchMatcher;
+}
+
+/**
+\brief Offline matcher for complete teach and replay recordings.
+
+Both recordings are read in full, then replay feature maps are evaluated against the
+teach frames in parallel: replay columns are split in blocks handed out to worker
+threads, and each block is evaluated in tiles of image rows over consecutive teach
+frames (see <tt>tileFrames()</tt>). Only the band of teach frames each replay frame can be
+compared to is evaluated and kept.
+
+Replaying the online matcher is then a matter of tallying the stored cells over each
+window position, fitting lines over the resulting similarity maps (again in parallel),
+and emitting matches the way <tt>VisualMatcher</tt> does with a fixed window.
+*/
+struct cight::BatchMatcher {
+    /** \brief Teach recording. Its buffer grows to hold the whole recording. */
+    StreamTeachV teach;
+
+    /** \brief Replay recording. Its buffer grows to hold the whole recording. */
+    StreamReplayV replay;
+
+    /** \brief Per-feature similarities of each replay frame, over the teach frames in its band. */
+    std::vector<cv::Mat> cells;
+
+    /** \brief Teach frames covered by each replay frame's cells. */
+    std::vector<cv::Range> ranges;
+
+    /** \brief Number of worker threads, or 0 to use one per available core. */
+    int threads;
+
+    /**
+    \brief Default constructor.
+    */
+    BatchMatcher();
+
+    /**
+    \brief Creates a new batch matcher over the given recordings.
+
+    Parameters are as for <tt>VisualMatcher</tt>. Recordings are read when first needed.
+    */
+    BatchMatcher(
+        SensorStream teach,
+        SensorStream replay,
+        Selector selector,
+        int padding_a,
+        int padding_b,
+        Comparator comparator = CORRELATION,
+        int threads = 0
+    );
+
+    /**
+    \brief Reads both recordings in full, unless already done.
+
+    Recordings are read concurrently, each on its own background thread.
+    */
+    void load();
+
+    /**
+    \brief Evaluates every replay frame against every teach frame.
+    */
+    void evaluate();
+
+    /**
+    \brief Evaluates each replay frame \c j against the teach frames in <tt>bands[j]</tt>.
+    */
+    void evaluate(const std::vector<cv::Range> &bands);
+
+    /**
+    \brief Returns the similarity map between all teach (rows) and replay (columns) frames.
+
+    Each replay frame's feature points vote over all the teach frames it was evaluated
+    against. Cells outside evaluated bands are zero.
+    */
+    cv::Mat similarities() const;
+
+    /**
+    \brief Returns the similarity map of the window of given size starting at teach and replay frame \c s.
+
+    This is the map the online matcher would compute at that position. The window must
+    lie within the evaluated bands.
+    */
+    cv::Mat similarities(int s, const cv::Size &window) const;
+
+    /**
+    \brief Reproduces the online matcher's output over the whole recordings.
+
+    Evaluates the bands needed by windows of the given size, fits a line over every
+    window position with the given interpolator, and returns the resulting matches as
+    (replay, teach) frame indices, in the order <tt>VisualMatcher</tt> would return them.
+    */
+    clarus::List<cv::Point> operator () (const cv::Size &window, const Interpolator &interpolator);
+
+private:
+    /**
+    \brief Evaluates the given block of replay frames against their bands.
+    */
+    void evaluateBlock(const std::vector<cv::Range> &bands, int block);
+
+    /**
+    \brief Fits a line over the window of given size starting at frame \c s.
+    */
+    void fitWindow(const Interpolator &interpolator, const cv::Size &window, std::vector<cv::Point3f> &lines, int s) const;
+
+    /**
+    \brief Returns the number of worker threads to use.
+    */
+    int workers() const;
+};
+
+#endif
@@ -0,0 +1,147 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIGHT_BIT_IMAGE_HPP
+#define CIGHT_BIT_IMAGE_HPP
+
+#include <boost/cstdint.hpp>
+
+#include <opencv2/opencv.hpp>
+
+namespace cight {
+    class BitImage;
+
+    /**
+    \brief Returns the number of set bits in the given word.
+    */
+    inline int popcount(boost::uint64_t bits) {
+#ifdef __GNUC__
+        return __builtin_popcountll(bits);
+#else
+        bits = bits - ((bits >> 1) & 0x5555555555555555ULL);
+        bits = (bits & 0x3333333333333333ULL) + ((bits >> 2) & 0x3333333333333333ULL);
+        bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return (bits * 0x0101010101010101ULL) >> 56;
+#endif
+    }
+
+    /**
+    \brief Returns the index of the lowest set bit in the given (non-zero) word.
+    */
+    inline int lowestBit(boost::uint64_t bits) {
+#ifdef __GNUC__
+        return __builtin_ctzll(bits);
+#else
+        int index = 0;
+        while ((bits & 1) == 0) {
+            bits >>= 1;
+            index++;
+        }
+
+        return index;
+#endif
+    }
+}
+
+/**
+\brief A binary image packed at one bit per pixel.
+
+Each row is stored as a sequence of 64-bit words, the lowest bit of the first word
+holding the leftmost pixel. Bits past the image width are always clear.
+*/
+class cight::BitImage {
+    /** \brief Packed rows. */
+    cv::Mat words;
+
+    /** \brief Image width in pixels. */
+    int width;
+
+    /** \brief Value of set pixels in the unpacked image. */
+    double on;
+
+public:
+    /**
+    \brief Default constructor. Creates an empty image.
+    */
+    BitImage();
+
+    /**
+    \brief Packs the given single-channel mask, setting the bits of non-zero pixels.
+
+    The value of set pixels (e.g. 255 for masks produced by thresholding) is recorded, so
+    counts computed from packed images can be scaled back to the units of the mask.
+    */
+    BitImage(const cv::Mat &mask);
+
+    /**
+    \brief Returns the number of rows.
+    */
+    int rows() const;
+
+    /**
+    \brief Returns the number of columns (pixels per row).
+    */
+    int cols() const;
+
+    /**
+    \brief Returns the number of words per row.
+    */
+    int span() const;
+
+    /**
+    \brief Returns the value of set pixels in the original mask, or 0 if none was set.
+    */
+    double level() const;
+
+    /**
+    \brief Returns a pointer to the words of row \c i.
+    */
+    const boost::uint64_t *row(int i) const;
+
+    /**
+    \brief Returns the image unpacked into a \c CV_8U mask of given pixel value.
+    */
+    cv::Mat unpack(uchar value = 255) const;
+};
+
+namespace cight {
+    /**
+    \brief Adds one to every pixel of \c counts where the given images differ.
+
+    \c counts must be a \c CV_32S matrix of the images' size.
+    */
+    void accumulate_changes(const BitImage &u, const BitImage &v, cv::Mat &counts);
+
+    /**
+    \brief Adds the number of differing pixels over each of \c bins equal-width column ranges to \c totals.
+
+    \c totals must be a <tt>1 &times; bins</tt> \c CV_32S matrix. As with
+    <tt>column_histogram()</tt>, columns past <tt>bins * (cols / bins)</tt> are ignored.
+    */
+    void accumulate_changes(const BitImage &u, const BitImage &v, size_t bins, cv::Mat &totals);
+
+    /**
+    \brief Adds the number of set pixels over each of \c bins equal-width column ranges to \c totals.
+
+    Works as the two-image version, counting set pixels instead of differences.
+    */
+    void accumulate_bins(const BitImage &u, size_t bins, cv::Mat &totals);
+}
+
+#endif
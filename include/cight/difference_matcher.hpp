@@ -59,6 +59,12 @@ struct cight::DifferenceMatcher {
     /** \brief Index of the next matching to return. */
     int index;
 
+    /** \brief Smallest similarity window size, as replay (width) and teach (height) frame counts. */
+    cv::Size windowMin;
+
+    /** \brief Largest similarity window size. Windows adapt between the bounds unless they are equal. */
+    cv::Size windowMax;
+
     /**
     \brief Default constructor.
     */
@@ -81,6 +87,17 @@ struct cight::DifferenceMatcher {
     \brief Compute the matching trend between streams.
     */
     bool computeMatching();
+
+    /**
+    \brief Resizes the teach and replay windows to suit the current line and its confidence.
+
+    Windows shrink on well-tracked segments and grow back when the fit degrades; see
+    <tt>adaptWindow()</tt>. The fit is judged by the similarity map's confidence,
+    which is measured over unbanded probe columns (see <tt>fit()</tt>), so it drops
+    when the line drifts off even while banding is on. Nothing happens if the window
+    bounds are equal.
+    */
+    void adapt();
 };
 
 #endif
@@ -0,0 +1,95 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIGHT_DIFFERENCE_SOURCE_HPP
+#define CIGHT_DIFFERENCE_SOURCE_HPP
+
+#include <cight/difference_stream.hpp>
+#include <cight/route_file.hpp>
+#include <cight/sensor_stream.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <boost/shared_ptr.hpp>
+
+namespace cight {
+    class DifferenceSource;
+}
+
+/**
+\brief Random-access source of difference images, indexed from the first difference of a recording.
+
+Index \c k always refers to the k-th difference image a <tt>DifferenceStream</tt>
+would produce from the same recording, which is how the pairing files read by
+<tt>MockMatcher</tt> number images. Sources can only be built over data that yields
+difference images:
+
+- A precomputed route, whose <tt>ROUTE_DIFFS</tt> layer is read directly;
+- A sensor stream, differenced on the fly. Images are read forward as needed and
+  kept in a buffer of given size, so only indices within the buffer behind the
+  newest image can be revisited.
+
+Copies of a source share the same underlying route or stream.
+*/
+class cight::DifferenceSource {
+    /** \brief Precomputed route, if reading from one. */
+    RouteFile route;
+
+    /** \brief Difference stream, if reading from a sensor stream. */
+    boost::shared_ptr<DifferenceStream> stream;
+
+    /** \brief Number of difference images read from the stream so far. */
+    boost::shared_ptr<int> produced;
+
+public:
+    /**
+    \brief Default constructor. Creates an empty source.
+    */
+    DifferenceSource();
+
+    /**
+    \brief Creates a source over the difference images of a precomputed route.
+
+    Throws <tt>std::runtime_error</tt> if the route holds no difference images.
+    */
+    DifferenceSource(const RouteFile &route);
+
+    /**
+    \brief Creates a source differencing the given sensor stream.
+
+    \c size is the number of difference images kept for revisiting, and
+    \c threshold the minimum difference between kept frames (see
+    <tt>DifferenceStream</tt>).
+    */
+    DifferenceSource(SensorStream stream, size_t size, double threshold);
+
+    /**
+    \brief Returns the k-th difference image, or an empty matrix if the recording ends before it.
+
+    Throws <tt>std::runtime_error</tt> if a stream source has already discarded it.
+    */
+    cv::Mat operator () (int k);
+
+    /**
+    \brief Returns whether the source is empty.
+    */
+    bool empty() const;
+};
+
+#endif
@@ -20,6 +20,7 @@ along with Cight. If not, see <http://www.gnu.org/licenses/>.
 #ifndef CIGHT_DIFFERENCE_STREAM_HPP
 #define CIGHT_DIFFERENCE_STREAM_HPP
 
+#include <cight/route_file.hpp>
 #include <cight/stream_buffer.hpp>
 
 #include <clarus/core/list.hpp>
@@ -47,6 +48,12 @@ struct cight::DifferenceStream: public StreamBuffer {
     /** \brief Minimal difference between frames. */
     double threshold;
 
+    /** \brief Precomputed route to read frames and differences from, instead of the input stream. */
+    RouteFile route;
+
+    /** \brief Index of the next route difference image to read. */
+    size_t cursor;
+
     /**
     \brief Default constructor.
     */
@@ -60,6 +67,15 @@ struct cight::DifferenceStream: public StreamBuffer {
     */
     DifferenceStream(SensorStream stream, size_t size, double threshold);
 
+    /**
+    \brief Creates a new differential stream reading from a precomputed route.
+
+    Frames and difference images are read from the route's <tt>ROUTE_FRAMES</tt>,
+    <tt>ROUTE_INDICES</tt> and <tt>ROUTE_DIFFS</tt> layers; the threshold is the one
+    the route was compiled with.
+    */
+    DifferenceStream(const RouteFile &route, size_t size);
+
     /**
     \brief Returns the next difference image computed from the underlying sensor stream.
 
@@ -78,6 +94,11 @@ struct cight::DifferenceStream: public StreamBuffer {
     If the maximum buffer size is reached, the buffer's first item is discarded.
     */
     virtual bool read();
+
+    /**
+    \brief Changes the maximum number of difference images, discarding the oldest that no longer fit.
+    */
+    virtual void resize(size_t size);
 };
 
 #endif
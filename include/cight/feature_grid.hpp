@@ -0,0 +1,165 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIGHT_FEATURE_GRID_HPP
+#define CIGHT_FEATURE_GRID_HPP
+
+#include <cight/feature_point.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+namespace cight {
+    struct Candidate;
+
+    class CandidateGrid;
+
+    class ExclusionGrid;
+
+    /**
+    \brief Orders candidates by decreasing strength, breaking ties by raster position.
+
+    Used as a "less than" comparator this sorts candidates strongest first; used with
+    the standard heap functions, it keeps the weakest candidate at the front.
+    */
+    bool strongerCandidate(const Candidate &a, const Candidate &b);
+}
+
+/**
+\brief A candidate feature point, not yet bound to an image patch.
+*/
+struct cight::Candidate {
+    /** \brief Horizontal coordinate. */
+    int x;
+
+    /** \brief Vertical coordinate. */
+    int y;
+
+    /** \brief Selection strength. */
+    float strength;
+
+    /**
+    \brief Creates a new candidate at the given coordinates.
+    */
+    Candidate(int x, int y, float strength);
+};
+
+/**
+\brief Coarse grid of candidate buckets, used for non-maximum suppression.
+
+The image is divided in square cells of given side. Each cell keeps at most \c top
+candidates, the weakest being evicted as stronger ones arrive.
+*/
+class cight::CandidateGrid {
+    /** \brief Side of grid cells, in pixels. */
+    int side;
+
+    /** \brief Number of cell columns in the grid. */
+    int cols;
+
+    /** \brief Maximum number of candidates kept per cell. */
+    size_t top;
+
+    /** \brief Per-cell candidate buckets, each organized as a min-heap. */
+    std::vector<std::vector<Candidate> > cells;
+
+public:
+    /**
+    \brief Creates a new grid covering an image of given size.
+    */
+    CandidateGrid(const cv::Size &size, int side, int top);
+
+    /**
+    \brief Offers a candidate to the grid.
+
+    The candidate is kept if its cell is not yet full, or if it's stronger than the
+    weakest candidate currently kept there.
+    */
+    void insert(int x, int y, float strength);
+
+    /**
+    \brief Returns the strongest <tt>budget</tt> candidates kept by the grid.
+
+    If <tt>budget &le; 0</tt> all kept candidates are returned. Candidates are sorted
+    by decreasing strength.
+    */
+    std::vector<Candidate> select(int budget) const;
+};
+
+/**
+\brief Spatial hash of the exclusion squares claimed by disjoint feature points.
+
+The grid's cell side equals the side of the squares, so each square overlaps at most
+four cells, and each query only needs to test the squares registered on one cell.
+*/
+class cight::ExclusionGrid {
+    /** \brief Size of the covered image. */
+    cv::Size size;
+
+    /** \brief Padding of the feature points being selected. */
+    int padding;
+
+    /** \brief Side of exclusion squares and grid cells, in pixels. */
+    int side;
+
+    /** \brief Number of cell columns in the grid. */
+    int cols;
+
+    /** \brief Number of cell rows in the grid. */
+    int rows;
+
+    /** \brief Exclusion squares overlapping each cell. */
+    std::vector<std::vector<cv::Rect> > cells;
+
+    int cellX(int x) const;
+
+    int cellY(int y) const;
+
+public:
+    /**
+    \brief Default constructor.
+    */
+    ExclusionGrid();
+
+    /**
+    \brief Creates a new grid covering an image of given size.
+
+    Exclusion squares have side <tt>4 * padding + 1</tt>.
+    */
+    ExclusionGrid(const cv::Size &size, int padding);
+
+    /**
+    \brief Clears all claims and resizes the grid for an image of given size.
+
+    Cell buffers are retained, so a grid reset for images of constant size does not
+    allocate memory once warmed up.
+    */
+    void reset(const cv::Size &size, int padding);
+
+    /**
+    \brief Tries to claim the exclusion square around a feature point's center.
+
+    Returns \c false if the (border-adjusted) center is already excluded by a previous
+    claim; otherwise registers the square around it and returns \c true.
+    */
+    bool claim(const cv::Point &center);
+};
+
+#endif
@@ -23,33 +23,92 @@ along with Cight. If not, see <http://www.gnu.org/licenses/>.
 #include <cight/feature_point.hpp>
 #include <cight/feature_selector.hpp>
 #include <cight/settings.hpp>
+#include <cight/teach_window.hpp>
 
 #include <clarus/core/list.hpp>
 
 #include <opencv2/opencv.hpp>
 
+#include <vector>
+
 namespace cight {
     class FeatureMap;
 }
 
+/**
+\brief A set of feature points extracted from a single image.
+
+Feature point patches are copied into a contiguous arena owned by the map, so the map
+does not keep the source image alive. Patches are packed back to back, one block of
+rows per patch, with rows padded to a multiple of 16 bytes; means and norms of each
+patch are computed once, when the map is created. Census transforms of the patches,
+needed only against \c CENSUS teach windows, are computed on first use; that cache is
+not synchronized, so a map should not be matched from several threads at once.
+*/
 class cight::FeatureMap {
-    /** \brief Feature points collected in this map. */
+    /** \brief Feature points collected in this map. Patches are views into the arena. */
     clarus::List<FeaturePoint> features;
 
+    /** \brief Patch arena. */
+    cv::Mat arena;
+
+    /** \brief Census transforms of feature point patches, packed as the patches are, or empty until first needed. */
+    mutable cv::Mat codes;
+
+    /** \brief Side of the (square) feature point patches. */
+    int side;
+
+    /** \brief Bounds of each feature point's patch. */
+    std::vector<cv::Rect> bounds;
+
+    /** \brief Strength of each feature point. */
+    std::vector<float> strengths;
+
+    /** \brief Mean value of each feature point's patch. */
+    std::vector<float> means;
+
+    /** \brief L2 norm of each feature point's patch. */
+    std::vector<float> norms;
+
+    /**
+    \brief Copies feature point patches into the arena and computes their statistics.
+    */
+    void pack();
+
+    /**
+    \brief Returns the first frame in <tt>[i0, n)</tt> where feature point \c j yields its best response.
+    */
+    int bestFrame(const cv::Mat &similarities, int j, int i0, int n) const;
+
 public:
+    /**
+    \brief Default constructor. Creates an empty feature map.
+    */
+    FeatureMap();
+
     /**
     \brief Creates a new feature map of given configuration.
 
     The given selector is used to extract a number of feature points from the given
-    image.
+    frame.
     */
-    FeatureMap(Selector selector, const cv::Mat &bgr, int padding);
+    FeatureMap(Selector selector, const Frame &frame, int padding);
 
     /**
     \brief Creates a new feature map containing the given features.
     */
     FeatureMap(const clarus::List<FeaturePoint> &features);
 
+    /**
+    \brief Returns a map of the same feature points, extracted from the Sobel edge map of level \c n of the given frame's pyramid.
+
+    The frame should be the one this map was selected from. Coordinates are scaled
+    down to the level, and patches are cut from the level's edge map, the same image
+    coarse teach windows hold, with their half-side halved at every level (down to a
+    minimum of 1).
+    */
+    FeatureMap reduced(const Frame &frame, int n) const;
+
     /**
     \brief Evaluates the similarity between this feature map and the given image list.
 
@@ -72,10 +131,265 @@ public:
     */
     clarus::List<cv::Mat> operator () (const clarus::List<cv::Mat> &images, int padding, int i0 = 0, int n = 0) const;
 
+    /**
+    \brief Evaluates the similarity between this feature map and the frames of a teach window.
+
+    Works as the image list version, and with the window's default \c CORRELATION
+    comparator yields the same similarity values (see <tt>correlateFourier()</tt>).
+
+    With the \c DIRECT comparator, each feature point is instead evaluated against
+    all frames in <tt>[i0, n)</tt> in a single pass over its search neighborhood (see
+    <tt>correlateWindow()</tt>). Similarity values are then the peaks of the direct
+    cross-correlation between patch and neighborhood, taken over positions where the
+    patch fits entirely inside the neighborhood.
+
+    If the window uses the \c CENSUS comparator, patches are compared by the number
+    of equal bits between their census transforms and those of the frames (see
+    <tt>matchCensus()</tt>).
+
+    If \c exact is \c false, correlations that cannot beat a feature point's best
+    response so far are skipped (see <tt>prune()</tt>). The similarity vector is the
+    same in both modes, but the similarity map is only filled where needed. Pruning
+    only applies to the \c DIRECT comparator.
+
+    Search neighborhoods can be moved horizontally by \c shift pixels and, if
+    \c radius is non-negative, limited to \c radius pixels left and right of the
+    (shifted) patch position (see <tt>FeaturePoint::neighborhood()</tt>).
+
+    The similarity map is of the type given by <tt>similarityType()</tt>: with the
+    \c DIRECT comparator, 8-bit inputs are correlated in integer arithmetic, and only
+    the similarity vector is in floating point. \c CORRELATION always yields floating
+    point similarities, as the Fourier transform does not work on integers.
+
+    A third matrix is added to the results: a single-row \c CV_32S displacement
+    vector, holding for each feature point the horizontal offset of its best match
+    relative to its original position.
+    */
+    clarus::List<cv::Mat> operator () (
+        const TeachWindow &window,
+        int padding,
+        int i0 = 0,
+        int n = 0,
+        bool exact = true,
+        int shift = 0,
+        int radius = -1
+    ) const;
+
+    /**
+    \brief Computes the similarities of each feature point against teach frames <tt>[i0, n)</tt>.
+
+    Results are written to rows <tt>[i0, n)</tt> of the given matrix, one column per
+    feature point; the matrix must be of the type returned by <tt>similarityType()</tt>
+    and have one row per window frame. Other rows are left untouched. The horizontal
+    position of each match is likewise written to the \c CV_32S matrix \c offsets.
+    Each feature point is correlated against its own neighborhood only, so that the
+    values match those of <tt>FeaturePoint::operator ()</tt>.
+
+    If \c strip is given, only feature points whose search neighborhoods start within
+    that range of image rows are evaluated; see <tt>tileFrames()</tt>. If \c first is
+    given, frame \c i is written to row <tt>i - first</tt> of both matrices instead,
+    which then need only span the evaluated frames.
+
+    See <tt>operator () (window, ...)</tt> for the meaning of \c shift and \c radius.
+    */
+    void evaluate(
+        const TeachWindow &window,
+        int padding,
+        int i0,
+        int n,
+        cv::Mat &similarities,
+        cv::Mat &offsets,
+        int shift = 0,
+        int radius = -1,
+        const cv::Range &strip = cv::Range::all(),
+        int first = 0
+    ) const;
+
+    /**
+    \brief Returns the type of similarity maps computed against the given teach window.
+
+    This is \c CV_32S when patches are correlated against the window's frames in
+    integer arithmetic, i.e. both are 8-bit and the window uses the \c DIRECT
+    comparator; and \c CV_32F otherwise.
+    */
+    int similarityType(const TeachWindow &window) const;
+
+    /**
+    \brief Computes the similarity vector from a similarity map over teach frames <tt>[i0, n)</tt>.
+
+    Each feature point votes for the first frame in the range where it yielded its
+    best response.
+    */
+    cv::Mat tally(const cv::Mat &similarities, int i0, int n) const;
+
+    /**
+    \brief Computes the displacement vector from similarity and offset maps over teach frames <tt>[i0, n)</tt>.
+
+    Each feature point's displacement is taken from the same frame it votes for in
+    <tt>tally()</tt>.
+    */
+    cv::Mat displacements(const cv::Mat &similarities, const cv::Mat &offsets, int i0, int n) const;
+
+    /**
+    \brief Computes the similarity vector over teach frames <tt>[i0, n)</tt>, skipping hopeless correlations.
+
+    For each feature point, an upper bound on its response to each frame is computed
+    from the patch norm and the energies of the frame's neighborhood (see
+    <tt>correlationBound()</tt>). Frames are then evaluated in decreasing order of
+    bound, stopping as soon as no remaining frame can beat (or tie at a lower index)
+    the best response found so far.
+
+    Evaluated similarities and offsets are written to the given matrices as in
+    <tt>evaluate()</tt>; skipped entries are left untouched. \c evaluated is a
+    \c CV_8U mask of the same size, marking cells already filled: those are taken as
+    they are, and cells evaluated here are marked in turn. Votes are added to the
+    given response vector, and the displacement of each feature point's best match is
+    written to the given displacement vector.
+
+    The bound only holds for the \c DIRECT comparator, which correlates over positions
+    where the patch fits entirely. \c CORRELATION peaks come from
+    <tt>fourier::correlate()</tt>, whose border handling also scores positions where
+    the patch overlaps the neighborhood only in part, and \c CENSUS scores are bit
+    counts rather than dot products; windows using either are rejected.
+    */
+    void prune(
+        const TeachWindow &window,
+        int padding,
+        int i0,
+        int n,
+        cv::Mat &similarities,
+        cv::Mat &offsets,
+        cv::Mat &evaluated,
+        cv::Mat &responses,
+        cv::Mat &displacements,
+        int shift = 0,
+        int radius = -1
+    ) const;
+
     /**
     \brief Returns the number of feature points contained by this map.
     */
     size_t size() const;
+
+    /**
+    \brief Returns the side of this map's feature point patches, or 0 if the map is empty.
+    */
+    int patchSide() const;
+
+    /**
+    \brief Returns the patch of feature point \c j, as a view into the arena.
+    */
+    cv::Mat patch(int j) const;
+
+    /**
+    \brief Returns the census transform of feature point \c j's patch, as a view into the census arena.
+
+    Transforms of all patches are computed on the first call. Each patch is coded on
+    its own, with its borders replicated, so codes never depend on neighboring patches
+    in the arena or on whatever image the patch was cut from.
+    */
+    cv::Mat patchCensus(int j) const;
+
+    /**
+    \brief Returns the patch bounds of feature point \c j.
+    */
+    const cv::Rect &patchBounds(int j) const;
+
+    /**
+    \brief Returns the strength of feature point \c j.
+    */
+    float strength(int j) const;
+
+    /**
+    \brief Returns the mean value of feature point \c j's patch.
+    */
+    float patchMean(int j) const;
+
+    /**
+    \brief Returns the L2 norm of feature point \c j's patch.
+    */
+    float patchNorm(int j) const;
 };
 
+namespace cight {
+    /**
+    \brief Returns the height of the row strips feature maps <tt>[j0, j1)</tt> are evaluated in.
+
+    This is the tallest search neighborhood among the maps' feature points.
+    */
+    int stripHeight(const clarus::List<FeatureMap> &maps, int j0, int j1, int padding);
+
+    /**
+    \brief Returns the number of consecutive frames in a tile of the given teach window.
+
+    Tiles cover a strip of \c height image rows over a run of consecutive frames.
+    Feature points whose neighborhoods start within the strip reach at most \c height
+    rows below it, so the tile is sized for twice as many rows per frame to fit in
+    about <tt>TILE_CACHE_BYTES</tt>.
+    */
+    int tileFrames(const TeachWindow &window, int height);
+
+    /**
+    \brief Evaluates feature maps <tt>[j0, j1)</tt> from the given list against a teach window.
+
+    Returns one result list per map, the same as calling each map on the window in
+    turn. The window is traversed in tiles of image rows over consecutive frames
+    (see <tt>tileFrames()</tt>), and every map is evaluated against a tile before
+    moving on to the next, so frame rows are brought into cache once per batch
+    instead of once per map.
+
+    If \c exact is \c false and the window uses the \c DIRECT comparator, each map
+    is instead evaluated through <tt>FeatureMap::prune()</tt>, which already limits
+    traversal to the few frames that matter.
+
+    See <tt>FeatureMap::operator () (window, ...)</tt> for the meaning of \c shift
+    and \c radius.
+    */
+    clarus::List<clarus::List<cv::Mat> > evaluateBatch(
+        const clarus::List<FeatureMap> &maps,
+        int j0,
+        int j1,
+        const TeachWindow &window,
+        int padding,
+        bool exact = true,
+        int shift = 0,
+        int radius = -1
+    );
+
+    /**
+    \brief Evaluates the given feature maps against a teach window, reusing earlier results.
+
+    \c similarities and \c offsets hold the matrices computed for the first maps in
+    the list on a previous call, before the window slid forward by \c slid frames,
+    and \c evaluated a \c CV_8U mask of the cells filled in each. Those matrices are
+    moved up by \c slid rows and only cells not yet evaluated are filled; maps without
+    earlier results start from empty matrices. On return the lists hold one
+    up-to-date entry per map, ready for the next call.
+
+    If \c bands is not empty, it holds one range of rows per map, and each map is
+    evaluated and tallied only over its range; otherwise the whole window is used.
+
+    \c exact, \c shift and \c radius work as in <tt>evaluateBatch()</tt>, except
+    that each map keeps the search it was first evaluated with, recorded in
+    \c searches as a <tt>(shift, radius)</tt> point, so that cells computed at
+    different times remain comparable. If pruning applies, maps are evaluated through
+    <tt>FeatureMap::prune()</tt>, starting from the cells already evaluated.
+    Returns one result list per map.
+    */
+    clarus::List<clarus::List<cv::Mat> > evaluateIncremental(
+        const clarus::List<FeatureMap> &maps,
+        const TeachWindow &window,
+        int padding,
+        int slid,
+        clarus::List<cv::Mat> &similarities,
+        clarus::List<cv::Mat> &offsets,
+        clarus::List<cv::Mat> &evaluated,
+        clarus::List<cv::Point> &searches,
+        const std::vector<cv::Range> &bands = std::vector<cv::Range>(),
+        bool exact = true,
+        int shift = 0,
+        int radius = -1
+    );
+}
+
 #endif
@@ -0,0 +1,372 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIGHT_FEATURE_PIPELINE_HPP
+#define CIGHT_FEATURE_PIPELINE_HPP
+
+#include <cight/feature_grid.hpp>
+#include <cight/feature_point.hpp>
+#include <cight/feature_selector.hpp>
+#include <cight/frame.hpp>
+
+#include <clarus/core/list.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace cight {
+    struct PipeOutput;
+
+    template<class Next = PipeOutput> struct PipeAtMost;
+
+    template<class Next = PipeOutput> struct PipeDisjoint;
+
+    struct CandidateOrder;
+
+    template<class Source, class Stages = PipeOutput> class SelectorPipeline;
+
+    class SourceFAST;
+
+    class SourceGoodFeatures;
+
+    /**
+    \brief Returns a selector backed by one pipeline of given source and stages.
+
+    The pipeline is shared by all copies of the returned selector, so its buffers are
+    reused from call to call; copies must not be called concurrently.
+    */
+    template<class Source, class Stages> Selector bindPipeline(const Source &source, const Stages &stages);
+
+    /**
+    \brief Returns a selector backed by one stage-less pipeline of given source.
+    */
+    template<class Source> Selector bindPipeline(const Source &source);
+}
+
+/**
+\brief Terminal pipeline stage, which turns candidates into feature points.
+
+Feature points are appended to an output list owned by the enclosing pipeline.
+*/
+struct cight::PipeOutput {
+    /** \brief Image from which feature point patches are extracted. */
+    cv::Mat image;
+
+    /** \brief Padding of feature point patches. */
+    int padding;
+
+    /** \brief Output list. */
+    clarus::List<FeaturePoint> *arena;
+
+    /**
+    \brief Default constructor.
+    */
+    PipeOutput():
+        padding(0),
+        arena(NULL)
+    {
+        // Nothing to do.
+    }
+
+    /**
+    \brief Prepares the stage for a new selection round.
+    */
+    void start(const cv::Mat &_image, int _padding, clarus::List<FeaturePoint> &_arena) {
+        image = _image;
+        padding = _padding;
+        arena = &_arena;
+    }
+
+    /**
+    \brief Accepts the given candidate. Always returns \c true.
+    */
+    bool operator () (const Candidate &candidate) {
+        arena->append(FeaturePoint(candidate.x, candidate.y, candidate.strength, image, padding));
+        return true;
+    }
+};
+
+/**
+\brief Pipeline stage that lets at most a given number of candidates through.
+
+Once the limit is reached the stage returns \c false, stopping the pipeline.
+*/
+template<class Next> struct cight::PipeAtMost {
+    /** \brief Downstream stage. */
+    Next next;
+
+    /** \brief Maximum number of candidates let through. */
+    size_t limit;
+
+    /** \brief Number of candidates let through in the current round. */
+    size_t count;
+
+    /**
+    \brief Creates a new stage of given limit, feeding into the given downstream stage.
+    */
+    PipeAtMost(size_t _limit, const Next &_next = Next()):
+        next(_next),
+        limit(_limit),
+        count(0)
+    {
+        // Nothing to do.
+    }
+
+    void start(const cv::Mat &image, int padding, clarus::List<FeaturePoint> &arena) {
+        count = 0;
+        next.start(image, padding, arena);
+    }
+
+    bool operator () (const Candidate &candidate) {
+        if (count >= limit) {
+            return false;
+        }
+
+        count++;
+        return next(candidate) && count < limit;
+    }
+};
+
+/**
+\brief Pipeline stage that drops candidates overlapping previously accepted ones.
+
+Candidates are expected to arrive by decreasing strength, in which case the output
+is the same as that of cight::selectDisjoint().
+*/
+template<class Next> struct cight::PipeDisjoint {
+    /** \brief Downstream stage. */
+    Next next;
+
+    /** \brief Exclusion squares claimed by accepted candidates. */
+    ExclusionGrid claimed;
+
+    /** \brief Size of the input image. */
+    cv::Size size;
+
+    /** \brief Padding of feature point patches. */
+    int padding;
+
+    /**
+    \brief Creates a new stage feeding into the given downstream stage.
+    */
+    PipeDisjoint(const Next &_next = Next()):
+        next(_next),
+        padding(0)
+    {
+        // Nothing to do.
+    }
+
+    void start(const cv::Mat &image, int _padding, clarus::List<FeaturePoint> &arena) {
+        size = image.size();
+        padding = _padding;
+        claimed.reset(size, padding);
+        next.start(image, padding, arena);
+    }
+
+    bool operator () (const Candidate &candidate) {
+        cv::Rect bounds = FeaturePoint::boundsAt(candidate.x, candidate.y, size, padding);
+        cv::Point center(bounds.x + bounds.width / 2, bounds.y + bounds.height / 2);
+        if (!claimed.claim(center)) {
+            return true;
+        }
+
+        return next(candidate);
+    }
+};
+
+/**
+\brief Heap ordering of candidate indices: by increasing strength, then by decreasing index.
+
+Used as the comparator of a max-heap, it puts the strongest candidate on top, and the
+earliest detected among equally strong ones.
+*/
+struct cight::CandidateOrder {
+    /** \brief Candidates the indices refer to. */
+    const std::vector<Candidate> *candidates;
+
+    /**
+    \brief Creates a new ordering over the given candidates.
+    */
+    CandidateOrder(const std::vector<Candidate> &_candidates):
+        candidates(&_candidates)
+    {
+        // Nothing to do.
+    }
+
+    bool operator () (int a, int b) const {
+        float u = (*candidates)[a].strength;
+        float v = (*candidates)[b].strength;
+        return u < v || (u == v && a > b);
+    }
+};
+
+/**
+\brief A feature selector assembled at compile time from a source and a chain of stages.
+
+The source is a functor of signature <tt>cv::Mat (const Frame &frame, std::vector<Candidate> &candidates)</tt>,
+which fills the given vector with candidates in detection order, and returns the image
+from which patches should be extracted. Candidates are then streamed one at a time,
+by decreasing strength (ties in detection order), through the stages (e.g.
+<tt>PipeDisjoint<PipeAtMost<> ></tt>) until they are exhausted or a stage signals a
+limit was reached. Accepted candidates become feature points appended straight to the
+returned list, which is reserved to the previous call's output size, so a warmed-up
+pipeline performs no per-stage or output copies and one allocation per call.
+
+The source still detects every candidate in the frame; what stopping early saves is
+the work downstream of detection. Candidates are ordered through a heap, so a
+pipeline that stops after \c k candidates ranks them in <tt>O(n + k log n)</tt> time
+instead of sorting all \c n, and stages never see the candidates past the limit.
+
+Pipelines keep their buffers between calls, so a selector should hold on to one
+pipeline instead of building one per frame; cight::bindPipeline() wraps a shared
+pipeline into a cight::Selector, e.g.:
+
+    typedef PipeDisjoint<PipeAtMost<> > Stages;
+    Selector selector = bindPipeline(SourceFAST(cv::FastFeatureDetector(20)), Stages(PipeAtMost<>(50)));
+
+in place of <tt>selectDisjointAtMost(selectFAST(...), 50, ...)</tt>.
+*/
+template<class Source, class Stages> class cight::SelectorPipeline {
+    /** \brief Candidate source. */
+    Source source;
+
+    /** \brief Chain of filter stages. */
+    Stages stages;
+
+    /** \brief Candidate buffer. */
+    std::vector<Candidate> candidates;
+
+    /** \brief Heap of candidate indices, strongest on top. */
+    std::vector<int> order;
+
+    /** \brief Output list of the last call. */
+    clarus::List<FeaturePoint> arena;
+
+public:
+    /**
+    \brief Creates a new pipeline from the given source and stages.
+
+    The first output list is preallocated to hold the given number of feature points.
+    */
+    SelectorPipeline(const Source &_source, const Stages &_stages = Stages(), size_t capacity = 0):
+        source(_source),
+        stages(_stages)
+    {
+        arena->reserve(capacity);
+    }
+
+    /**
+    \brief Selects feature points from the given frame.
+
+    The returned list is the one the stages wrote into, not a copy. Each call starts a
+    new list, so lists returned by earlier calls are left untouched.
+    */
+    clarus::List<FeaturePoint> select(const Frame &frame, int padding) {
+        size_t expected = std::max(arena.size(), arena->capacity());
+        candidates.clear();
+        arena = clarus::List<FeaturePoint>();
+        arena->reserve(expected);
+
+        cv::Mat image = source(frame, candidates);
+
+        order.resize(candidates.size());
+        for (size_t k = 0, n = order.size(); k < n; k++) {
+            order[k] = k;
+        }
+
+        CandidateOrder weaker(candidates);
+        std::make_heap(order.begin(), order.end(), weaker);
+
+        stages.start(image, padding, arena);
+        for (std::vector<int>::iterator end = order.end(); end != order.begin(); --end) {
+            std::pop_heap(order.begin(), end, weaker);
+            if (!stages(candidates[*(end - 1)])) {
+                break;
+            }
+        }
+
+        return arena;
+    }
+
+    /**
+    \brief Adapter to the cight::Selector interface.
+    */
+    clarus::List<FeaturePoint> operator () (const Frame &frame, int padding) {
+        return select(frame, padding);
+    }
+};
+
+/**
+\brief Pipeline source based on FAST features, computed over the Sobel edge map.
+
+See cight::selectFAST().
+*/
+class cight::SourceFAST {
+    /** \brief Feature detector, copied from the one given at construction. */
+    cv::FastFeatureDetector detector;
+
+    /** \brief Keypoint buffer. */
+    std::vector<cv::KeyPoint> keypoints;
+
+public:
+    /**
+    \brief Creates a new source using a copy of the given detector.
+    */
+    SourceFAST(const cv::FastFeatureDetector &detector = cv::FastFeatureDetector());
+
+    cv::Mat operator () (const Frame &frame, std::vector<Candidate> &candidates);
+};
+
+/**
+\brief Pipeline source based on strong corners, computed over the Sobel edge map.
+
+See cight::selectGoodFeatures().
+*/
+class cight::SourceGoodFeatures {
+    /** \brief Feature detector, copied from the one given at construction. */
+    cv::GoodFeaturesToTrackDetector detector;
+
+    /** \brief Keypoint buffer. */
+    std::vector<cv::KeyPoint> keypoints;
+
+public:
+    /**
+    \brief Creates a new source using a copy of the given detector.
+    */
+    SourceGoodFeatures(const cv::GoodFeaturesToTrackDetector &detector = cv::GoodFeaturesToTrackDetector());
+
+    cv::Mat operator () (const Frame &frame, std::vector<Candidate> &candidates);
+};
+
+template<class Source, class Stages> cight::Selector cight::bindPipeline(const Source &source, const Stages &stages) {
+    typedef SelectorPipeline<Source, Stages> Pipeline;
+    boost::shared_ptr<Pipeline> pipeline(new Pipeline(source, stages));
+    return boost::bind(&Pipeline::operator (), pipeline, _1, _2);
+}
+
+template<class Source> cight::Selector cight::bindPipeline(const Source &source) {
+    return bindPipeline(source, PipeOutput());
+}
+
+#endif
@@ -56,6 +56,33 @@ struct cight::FeaturePoint {
 
     FeaturePoint(const cv::KeyPoint &point, const cv::Mat &image, int padding);
 
+    /**
+    \brief Creates a new feature point of given strength at or close to the given coordinates.
+
+    Works as <tt>FeaturePoint(x, y, image, padding)</tt>, except the strength value is
+    given instead of computed from the patch.
+    */
+    FeaturePoint(int x, int y, float strength, const cv::Mat &image, int padding);
+
+    /**
+    \brief Returns the bounds of the patch a feature point at the given coordinates would have.
+
+    See <tt>FeaturePoint(x, y, image, padding)</tt> for how coordinates are adjusted
+    near image borders.
+    */
+    static cv::Rect boundsAt(int x, int y, const cv::Size &size, int padding);
+
+    /**
+    \brief Returns the area searched for this feature point in teach images of the given size.
+
+    The area extends the patch bounds by the given padding on every side, shifted
+    inwards where it would otherwise fall outside image borders.
+
+    If given, \c shift moves the area horizontally, and a non-negative \c radius
+    replaces the padding on the left and right sides.
+    */
+    cv::Rect neighborhood(const cv::Size &size, int padding, int shift = 0, int radius = -1) const;
+
     /**
     \brief Cross-correlates the teach and replay patches around this feature point.
     */
@@ -21,6 +21,7 @@ along with Cight. If not, see <http://www.gnu.org/licenses/>.
 #define CIGHT_INTEREST_SELECTOR
 
 #include <cight/feature_point.hpp>
+#include <cight/frame.hpp>
 
 #include <clarus/core/list.hpp>
 
@@ -33,10 +34,12 @@ namespace cight {
     /**
     \brief Type of functions used to select interest regions in an input image.
 
-    Selector functions receive a BGR image and padding length as input, and output a
-    list of square interest regions of side <tt>2 * padding + 1</tt>.
+    Selector functions receive a frame (usually built around a BGR image) and padding
+    length as input, and output a list of square interest regions of side
+    <tt>2 * padding + 1</tt>. Image derivatives such as edge maps are requested from
+    the frame, so selectors composed over the same frame share them.
     */
-    typedef boost::function<clarus::List<FeaturePoint>(const cv::Mat&, int padding)> Selector;
+    typedef boost::function<clarus::List<FeaturePoint>(const Frame&, int padding)> Selector;
 
     /**
     \brief Enforces an upper limit on the number of returned interest regions.
@@ -44,7 +47,7 @@ namespace cight {
     If the number of interest regions returned by the given selector is greater than
     \c limit, excess regions are removed from the end of the list to make it fit.
     */
-    clarus::List<FeaturePoint> selectAtMost(Selector selector, int limit, const cv::Mat &bgr, int padding);
+    clarus::List<FeaturePoint> selectAtMost(Selector selector, int limit, const Frame &frame, int padding);
 
     /**
     \brief Filters selected interest regions by distance from the image center.
@@ -53,53 +56,118 @@ namespace cight {
     <tt>(int) (regions.size() * ratio)</tt> interest regions most distant from the
     image's center are selected and returned.
     */
-    clarus::List<FeaturePoint> selectBorders(Selector selector, float ratio, const cv::Mat &bgr, int padding);
+    clarus::List<FeaturePoint> selectBorders(Selector selector, float ratio, const Frame &frame, int padding);
 
     /**
     \brief Returns a non-overlapping subset of feature points selected by an upstream selector.
+
+    Feature points are visited by decreasing strength; each accepted point excludes a
+    square of side <tt>4 * padding + 1</tt> around it from further selection.
+    */
+    clarus::List<FeaturePoint> selectDisjoint(Selector selector, const Frame &frame, int padding);
+
+    /**
+    \brief Returns at most \c limit non-overlapping feature points selected by an upstream selector.
+
+    The result is the same as <tt>selectAtMost(selectDisjoint(...), limit, ...)</tt>, but
+    selection stops as soon as the limit is reached, so weaker upstream feature points
+    are never ranked.
     */
-    clarus::List<FeaturePoint> selectDisjoint(Selector selector, const cv::Mat &bgr, int padding);
+    clarus::List<FeaturePoint> selectDisjointAtMost(Selector selector, int limit, const Frame &frame, int padding);
+
+    /**
+    \brief Runs an upstream selector on a pyramid level, mapping its feature points back to full resolution.
+
+    The upstream selector is called on level \c level of the frame's Gaussian pyramid
+    (see cight::Frame::level()), with padding scaled down accordingly. Each returned
+    feature point is mapped to the center of the full-resolution block it covers and,
+    if <tt>refine &gt; 0</tt>, moved to the strongest Sobel response within \c refine
+    pixels of it. Full-resolution patches are then extracted from the frame's Sobel
+    edge map, which is what cight::selectFAST(), cight::selectGoodFeatures() and
+    cight::selectSaturation() use. Feature points that map to the same position are
+    reported only once, and keep the strength assigned by the upstream selector.
+    */
+    clarus::List<FeaturePoint> selectPyramid(Selector selector, int level, int refine, const Frame &frame, int padding);
 
     /**
     \brief Select feature points that are above the image's average intensity.
 
-    The image is assumed to be of type <tt>CV_8UC1</tt>.
+    The image is assumed to be of type <tt>CV_8UC1</tt>. Pixels brighter than the mean
+    are bucketed in a grid of square cells of side \c cell, where only the \c top
+    brightest pixels of each cell are kept. At most \c budget feature points (or all
+    kept points, if <tt>budget &le; 0</tt>) are returned, sorted by decreasing strength.
     */
-    clarus::List<FeaturePoint> selectAboveMean(const cv::Mat &image, int padding);
+    clarus::List<FeaturePoint> selectAboveMean(int cell, int top, int budget, const Frame &frame, int padding);
 
     /**
     \brief Select feature points based on the difference between a given image and a previous one.
 
     When using this selector, bind it to an empty cv::Mat object, e.g.:
 
-    Selector selector = boost::bind(selectDifference, boost::ref(cv::Mat()), 20.0, _1, _2);
+    Selector selector = boost::bind(selectDifference, boost::ref(cv::Mat()), 20.0, 16, 2, 100, _1, _2);
 
     The first call will result on an empty list, but the following ones will produce feature points
     based on the differences between successive inputs. (You could of course also bind it to the
     first image in a sequence and start feeding the selector the second image onwards, in which case
     the first output won't necessarily be empty.)
+
+    Pixels whose difference is above \c t are subject to the same grid non-maximum
+    suppression and global budget as in selectAboveMean().
     */
-    clarus::List<FeaturePoint> selectDifference(cv::Mat &previous, float t, const cv::Mat &image, int padding);
+    clarus::List<FeaturePoint> selectDifference(
+        cv::Mat &previous,
+        float t,
+        int cell,
+        int top,
+        int budget,
+        const Frame &frame,
+        int padding
+    );
 
     /**
     \brief Select feature points based on FAST features.
+
+    Feature points are sorted by decreasing response. This is a stage-less
+    <tt>SelectorPipeline<SourceFAST></tt>; to limit or thin out the selection, add
+    stages to the pipeline rather than wrapping this selector, so candidates past the
+    limit are never turned into feature points.
+
+    Each call builds a new pipeline; selectors called once per frame should be made
+    with <tt>selectorFAST()</tt> instead.
+    */
+    clarus::List<FeaturePoint> selectFAST(cv::FastFeatureDetector &detector, const Frame &frame, int padding);
+
+    /**
+    \brief Returns a FAST feature selector that keeps one pipeline across calls.
+
+    Selects the same feature points as <tt>selectFAST()</tt>; see also <tt>bindPipeline()</tt>.
     */
-    clarus::List<FeaturePoint> selectFAST(cv::FastFeatureDetector &detector, const cv::Mat &bgr, int padding);
+    Selector selectorFAST(const cv::FastFeatureDetector &detector);
 
     /**
     \brief Select feature points based on strong corners.
+
+    This is a stage-less <tt>SelectorPipeline<SourceGoodFeatures></tt>; see
+    <tt>selectFAST()</tt>.
     */
     clarus::List<FeaturePoint> selectGoodFeatures(
         cv::GoodFeaturesToTrackDetector &detector,
-        const cv::Mat &bgr,
+        const Frame &frame,
         int padding
     );
 
+    /**
+    \brief Returns a strong corner selector that keeps one pipeline across calls.
+
+    Selects the same feature points as <tt>selectGoodFeatures()</tt>.
+    */
+    Selector selectorGoodFeatures(const cv::GoodFeaturesToTrackDetector &detector);
+
     /**
     \brief Select interest regions based on saturation (the S channel of the HLS color
            space) outliers over the image.
     */
-    clarus::List<FeaturePoint> selectSaturation(const cv::Mat &bgr, int padding);
+    clarus::List<FeaturePoint> selectSaturation(const Frame &frame, int padding);
 }
 
 #endif
@@ -0,0 +1,99 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIGHT_FEATURE_TRACKER_HPP
+#define CIGHT_FEATURE_TRACKER_HPP
+
+#include <cight/feature_selector.hpp>
+#include <cight/frame.hpp>
+
+#include <clarus/core/list.hpp>
+
+#include <boost/shared_ptr.hpp>
+
+namespace cight {
+    class FeatureTracker;
+
+    struct FeatureTrackerState;
+}
+
+/**
+\brief A selector that tracks feature points across consecutive frames.
+
+On the first frame, and then on a fixed schedule, the tracker runs an upstream
+selector. On other frames, each feature point from the previous frame is searched in a
+small neighborhood of its last position, by normalized cross-correlation of its patch
+against the new frame's patch source; points whose best score falls below a
+threshold are dropped. If too few points survive, the upstream selector is run again.
+
+Points found at the same position with a near-perfect score keep their previous patch
+and strength, so unchanged image areas are not copied or measured again.
+
+The patch source must be the same frame derivative the upstream selector takes patches
+from (e.g. <tt>boost::bind(&Frame::sobel, _1)</tt> for <tt>selectFAST()</tt>).
+
+Trackers are meant to be passed wherever a Selector is expected, for instance to a
+replay stream. Copies of a tracker share the same tracking state.
+*/
+class cight::FeatureTracker {
+    /** \brief Tracking parameters and feature points from the last frame. */
+    boost::shared_ptr<FeatureTrackerState> state;
+
+public:
+    /**
+    \brief Creates a new feature tracker.
+
+    \param selector Upstream selector, used on the first frame and whenever tracking is reset.
+
+    \param source Transform returning the frame derivative patches are taken from.
+
+    \param interval Maximum number of frames between runs of the upstream selector; if zero, only track losses trigger new selections.
+
+    \param radius Search radius around the last position of each feature point.
+
+    \param threshold Minimum normalized correlation score for a feature point to be tracked.
+
+    \param tolerance Minimum fraction of selected feature points that must still be tracked.
+    */
+    FeatureTracker(
+        Selector selector,
+        Frame::Transform source,
+        int interval,
+        int radius,
+        float threshold,
+        float tolerance
+    );
+
+    /**
+    \brief Returns feature points for the given frame, tracked from the previous one or selected anew.
+    */
+    clarus::List<FeaturePoint> operator () (const Frame &frame, int padding);
+
+    /**
+    \brief Returns the number of frames since the upstream selector was last run.
+    */
+    int age() const;
+
+    /**
+    \brief Discards tracked feature points, so the next frame goes through the upstream selector.
+    */
+    void reset();
+};
+
+#endif
@@ -0,0 +1,124 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIGHT_FRAME_HPP
+#define CIGHT_FRAME_HPP
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+
+namespace cight {
+    class Frame;
+
+    struct FrameCache;
+}
+
+/**
+\brief An image together with a cache of images derived from it.
+
+Derivatives (grayscale, Sobel edges, pyramid levels and so on) are computed on first
+request and memoized, so selectors, streams and estimators working on the same frame
+compute each derivative only once. Copies of a frame share the same cache.
+
+Frames are implicitly constructible from images, so functions taking a frame can
+still be called with a plain cv::Mat, at the cost of losing the memoization across
+calls. The cache is not synchronized: a frame should not be shared between threads
+until all derivatives of interest have been computed.
+*/
+class cight::Frame {
+    /** \brief Source image and memoized derivatives. */
+    boost::shared_ptr<FrameCache> cache;
+
+public:
+    /**
+    \brief Type of functions that compute derivatives from a frame.
+    */
+    typedef boost::function<cv::Mat(const Frame&)> Transform;
+
+    /**
+    \brief Default constructor.
+    */
+    Frame();
+
+    /**
+    \brief Creates a new frame for the given image.
+    */
+    Frame(const cv::Mat &image);
+
+    /**
+    \brief Returns the frame's source image.
+    */
+    const cv::Mat &image() const;
+
+    /**
+    \brief Returns whether the source image is empty.
+    */
+    bool empty() const;
+
+    /**
+    \brief Returns the size of the source image.
+    */
+    cv::Size size() const;
+
+    /**
+    \brief Returns the derivative stored under the given key, computing it with the given transform if necessary.
+    */
+    const cv::Mat &derive(const std::string &key, Transform transform) const;
+
+    /**
+    \brief Returns the grayscale version of the source image.
+
+    If the source image is single-channel it is returned as is.
+    */
+    const cv::Mat &gray() const;
+
+    /**
+    \brief Returns the Sobel edge map of the grayscale image.
+    */
+    const cv::Mat &sobel() const;
+
+    /**
+    \brief Returns the horizontal Scharr gradient of the grayscale image.
+    */
+    const cv::Mat &scharr() const;
+
+    /**
+    \brief Returns the upper half of the source image.
+    */
+    const cv::Mat &upper() const;
+
+    /**
+    \brief Returns the saturation channel of the source image.
+    */
+    const cv::Mat &saturation() const;
+
+    /**
+    \brief Returns the given level of the frame's Gaussian pyramid as a frame in its own right.
+
+    Level 0 is the frame itself; each further level halves the previous one's
+    dimensions. Pyramid frames are memoized along with their own derivatives.
+    */
+    Frame level(int n) const;
+};
+
+#endif
@@ -24,6 +24,8 @@ along with Cight. If not, see <http://www.gnu.org/licenses/>.
 
 #include <opencv2/opencv.hpp>
 
+#include <vector>
+
 namespace cight {
     /**
     \brief Type of functions that interpolate a match line over a similarity map.
@@ -53,6 +55,26 @@ namespace cight {
     */
     cv::Point linePn(const cv::Point3f &line, const cv::Size &size);
 
+    /**
+    \brief Returns the range of rows within \c radius of the given line at column \c x, clipped to <tt>[0, rows)</tt>.
+    */
+    cv::Range lineBand(const cv::Point3f &line, int x, int radius, int rows);
+
+    /**
+    \brief Returns how well the given line fits the similarity map, in the range <tt>[0, 1]</tt>.
+
+    Confidence is the fraction of the map's total response that lies within one row
+    of the line, over the columns the line crosses.
+    */
+    float lineConfidence(const cv::Mat &similarities, const cv::Point3f &line);
+
+    /**
+    \brief Returns how well the given line fits the given columns of the similarity map.
+
+    Works as the whole-map version, restricted to the given column indices.
+    */
+    float lineConfidence(const cv::Mat &similarities, const cv::Point3f &line, const std::vector<int> &columns);
+
     /**
     \brief Brute-force interpolator.
     */
@@ -0,0 +1,74 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIGHT_MAPPED_FILE_HPP
+#define CIGHT_MAPPED_FILE_HPP
+
+#include <boost/shared_ptr.hpp>
+
+#include <cstddef>
+#include <string>
+
+namespace cight {
+    class MappedFile;
+
+    struct MappedRegion;
+}
+
+/**
+\brief A file mapped into memory in its entirety.
+
+The mapping is private: contents can be written through <tt>data()</tt>, but changes
+are never carried to the file. Copies of a mapped file share the same mapping, which
+is released when the last copy is destroyed.
+*/
+class cight::MappedFile {
+    /** \brief Mapped region. */
+    boost::shared_ptr<MappedRegion> region;
+
+public:
+    /**
+    \brief Default constructor. Creates an empty mapping.
+    */
+    MappedFile();
+
+    /**
+    \brief Maps the file at the given path.
+
+    Throws <tt>std::runtime_error</tt> if the file cannot be opened or mapped.
+    */
+    MappedFile(const std::string &path);
+
+    /**
+    \brief Returns the start of the mapped contents, or \c NULL if the mapping is empty.
+    */
+    unsigned char *data() const;
+
+    /**
+    \brief Returns the size of the mapped contents in bytes.
+    */
+    size_t size() const;
+
+    /**
+    \brief Returns whether the mapping is empty.
+    */
+    bool empty() const;
+};
+
+#endif
@@ -67,6 +67,13 @@ namespace cight {
 
     cv::Mat change_average(const Memory &memory);
 
+    /*
+    Returns the column histogram (see column_histogram()) of change_count(memory).
+    Each pair's thresholded difference is packed into a bit mask, and its set pixels
+    counted per bin (see accumulate_bins()) instead of summed as float images.
+    */
+    cv::Mat change_histogram(const Memory &memory, size_t bins);
+
     /*
     Returns the sum of absolute differences between each image in the buffer and the
     next.
@@ -79,6 +86,12 @@ namespace cight {
     */
     cv::Mat drift_edges(const Memory &memory);
 
+    /*
+    Returns the column histogram (see column_histogram()) of drift_edges(memory),
+    computed directly from packed edge maps.
+    */
+    cv::Mat drift_edges_histogram(const Memory &memory, size_t bins);
+
     /*
     Returns the difference count between the Sobel edge maps of each image in the buffer
     and the next, averaged over the number of images in the working memory.
@@ -20,6 +20,8 @@ along with Cight. If not, see <http://www.gnu.org/licenses/>.
 #ifndef CIGHT_MOCK_MATCHER_HPP
 #define CIGHT_MOCK_MATCHER_HPP
 
+#include <cight/difference_source.hpp>
+#include <cight/pairing_index.hpp>
 #include <cight/stream_teach.hpp>
 #include <cight/stream_replay.hpp>
 
@@ -39,6 +41,13 @@ namespace cight {
 
 /**
 \brief An image matcher that relies on a predefined data.
+
+Pairings are either read in sequence from a text file, advancing the teach stream up
+to each paired image, or looked up in a memory-mapped <tt>PairingIndex</tt>, fetching
+paired images straight from random-access difference sources. Either way, pairings
+number difference images, not raw frames: the sources used in random-access mode are
+<tt>DifferenceSource</tt> objects, which index difference images the same way the
+teach and replay streams produce them.
 */
 struct cight::MockMatcher {
     /** \brief Difference stream from the teach step. */
@@ -53,6 +62,18 @@ struct cight::MockMatcher {
     /** \brief Offset into the difference image range. */
     int offset;
 
+    /** \brief Binary pairing index, in random-access mode. */
+    PairingIndex index;
+
+    /** \brief Random-access source of teach difference images, in random-access mode. */
+    DifferenceSource teachDiffs;
+
+    /** \brief Random-access source of replay difference images, in random-access mode. */
+    DifferenceSource replayDiffs;
+
+    /** \brief Next pairing to return from the index. */
+    size_t next;
+
     /**
     \brief Default constructor.
     */
@@ -63,6 +84,22 @@ struct cight::MockMatcher {
     */
     MockMatcher(const std::string &path, const StreamTeach &teach, const StreamReplay &replay);
 
+    /**
+    \brief Creates a new mock stream matcher in random-access mode.
+
+    Pairings are taken in order from the given index, and paired difference images
+    fetched by index from the given sources: as in text mode, the k-th pairing matches
+    the k-th replay difference image to the teach image its record names. Route sources
+    are read without touching any intermediate images; stream sources read forward as
+    needed.
+    */
+    MockMatcher(const PairingIndex &index, const DifferenceSource &teach, const DifferenceSource &replay);
+
+    /**
+    \brief Moves to the k-th pairing, in random-access mode.
+    */
+    void seek(size_t k);
+
     /**
     \brief Returns a pair of matched difference images.
     */
@@ -0,0 +1,106 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIGHT_PAIRING_INDEX_HPP
+#define CIGHT_PAIRING_INDEX_HPP
+
+#include <cight/mapped_file.hpp>
+
+#include <boost/cstdint.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+
+namespace cight {
+    class PairingIndex;
+}
+
+/**
+\brief Read-only, memory-mapped index of ground-truth (replay, teach) difference image pairings.
+
+The binary format is a 24-byte header followed by one record per pairing:
+
+- Header: the magic string <tt>"CIGHTPIX"</tt>, a 32-bit format version (currently
+  1), 32 reserved bits and the 64-bit record count;
+- Records: the replay and teach difference image indices of each pairing, as 32-bit
+  signed integers, numbered as in the text pairing files (see
+  <tt>DifferenceSource</tt>). <tt>MockMatcher</tt> pairs the k-th record with the
+  k-th replay image, as it does with text files, so the replay index is informative.
+
+All fields are in the native byte order of the machine that wrote the file. Index
+files are produced from the text pairing files read by <tt>MockMatcher</tt> with
+<tt>convert()</tt>.
+
+Copies of an index share the same mapping, which is released when the last copy is
+destroyed.
+*/
+class cight::PairingIndex {
+    /** \brief Mapped file. */
+    MappedFile mapping;
+
+    /** \brief First record in the mapped file. */
+    const boost::int32_t *records;
+
+    /** \brief Number of records. */
+    size_t count;
+
+public:
+    /**
+    \brief Default constructor. Creates an empty index.
+    */
+    PairingIndex();
+
+    /**
+    \brief Maps the index file at the given path.
+
+    Throws <tt>std::runtime_error</tt> if the file cannot be mapped or is not a valid
+    index file.
+    */
+    PairingIndex(const std::string &path);
+
+    /**
+    \brief Converts a text pairing file into a binary index file.
+
+    Returns the number of pairings written.
+    */
+    static size_t convert(const std::string &text, const std::string &binary);
+
+    /**
+    \brief Returns the number of pairings in the index.
+    */
+    size_t size() const;
+
+    /**
+    \brief Returns whether the index has no pairings.
+    */
+    bool empty() const;
+
+    /**
+    \brief Returns the replay difference image index of the k-th pairing.
+    */
+    int replay(size_t k) const;
+
+    /**
+    \brief Returns the teach difference image index of the k-th pairing.
+    */
+    int teach(size_t k) const;
+};
+
+#endif
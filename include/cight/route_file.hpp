@@ -0,0 +1,172 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIGHT_ROUTE_FILE_HPP
+#define CIGHT_ROUTE_FILE_HPP
+
+#include <cight/mapped_file.hpp>
+#include <cight/sensor_stream.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+
+namespace cight {
+    class RouteFile;
+
+    struct RouteHeader;
+
+    struct RouteEntry;
+
+    /**
+    \brief Layers of precomputed teach data that can be stored in a route file.
+    */
+    enum RouteLayer {
+        /** \brief Grayscale version of every teach frame. */
+        ROUTE_GRAY = 0,
+
+        /** \brief Sobel edge map of every teach frame. */
+        ROUTE_EDGES = 1,
+
+        /** \brief Sobel edge map of a reduced pyramid level of every teach frame. */
+        ROUTE_COARSE = 2,
+
+        /** \brief Teach frames kept by the difference stream, one more than there are difference images. */
+        ROUTE_FRAMES = 3,
+
+        /** \brief Indices of the kept frames in the teach recording, as 1x1 \c CV_32S matrices. */
+        ROUTE_INDICES = 4,
+
+        /** \brief Difference images between successive kept frames. */
+        ROUTE_DIFFS = 5,
+
+        /** \brief Complex DFT spectra of the edge maps, as two-channel \c CV_32F matrices. */
+        ROUTE_SPECTRA = 6
+    };
+}
+
+/**
+\brief Precomputed teach route, memory-mapped from a binary route file.
+
+A route file stores, for a teach recording, everything the teach side of the matchers
+would otherwise compute at every replay: grayscale frames and edge maps for
+<tt>StreamTeachV</tt>, and kept frames, frame indices and difference images for
+<tt>StreamTeach</tt>. Route files are written once by <tt>compile()</tt>.
+
+The binary format starts with a header (the magic string <tt>"CIGHTRTE"</tt>, a 32-bit
+format version, the number of layers, the difference threshold and pyramid level the
+route was compiled with) followed by one table entry per layer, giving its identifier,
+frame dimensions and type, frame count, row step, frame stride and data offset. Layer
+data follows, each frame 64-byte aligned and each row 16-byte aligned. All fields are
+in the native byte order of the compiling machine.
+
+Frames are returned as views into the mapping, without copying. Views are writable,
+but changes are private to the process; they remain valid only as long as some copy of
+the route file they came from.
+*/
+class cight::RouteFile {
+    /** \brief Mapped route file. */
+    MappedFile mapping;
+
+    /** \brief Route header, at the start of the mapping. */
+    const RouteHeader *header;
+
+    /** \brief Layer table, following the header. */
+    const RouteEntry *entries;
+
+    /**
+    \brief Returns the table entry of the given layer, or \c NULL if it is not in the file.
+    */
+    const RouteEntry *entry(RouteLayer layer) const;
+
+public:
+    /**
+    \brief Default constructor. Creates an empty route.
+    */
+    RouteFile();
+
+    /**
+    \brief Maps the route file at the given path.
+
+    Throws <tt>std::runtime_error</tt> if the file cannot be mapped or is not a valid
+    route file.
+    */
+    RouteFile(const std::string &path);
+
+    /**
+    \brief Runs the teach pipelines over the given stream and writes the results to a route file.
+
+    \param stream Teach recording.
+
+    \param path Path of the route file to write. Temporary files are written next to it.
+
+    \param threshold Minimal difference between frames kept by the difference stream.
+
+    \param levels Pyramid level of the coarse edge maps, or 0 to leave them out.
+
+    \param spectra Whether to store DFT spectra of the edge maps.
+    */
+    static void compile(SensorStream stream, const std::string &path, double threshold, int levels = 0, bool spectra = false);
+
+    /**
+    \brief Returns whether no route is mapped.
+    */
+    bool empty() const;
+
+    /**
+    \brief Returns whether the route includes the given layer.
+    */
+    bool has(RouteLayer layer) const;
+
+    /**
+    \brief Returns the number of frames in the given layer, or 0 if it is not included.
+    */
+    size_t size(RouteLayer layer) const;
+
+    /**
+    \brief Returns a view of the k-th frame of the given layer.
+
+    Throws <tt>std::runtime_error</tt> if there is no such frame.
+    */
+    cv::Mat at(RouteLayer layer, size_t k) const;
+
+    /**
+    \brief Returns a view of the k-th frame of the given layer, or an empty matrix if there is none.
+
+    Bound to a layer, this is a <tt>FrameSource</tt>.
+    */
+    cv::Mat frame(RouteLayer layer, int k) const;
+
+    /**
+    \brief Returns the index in the teach recording of the k-th kept frame.
+    */
+    int index(size_t k) const;
+
+    /**
+    \brief Returns the difference threshold the route was compiled with.
+    */
+    double threshold() const;
+
+    /**
+    \brief Returns the pyramid level of the coarse edge maps, or 0 if they are not included.
+    */
+    int level() const;
+};
+
+#endif
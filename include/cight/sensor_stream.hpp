@@ -29,6 +29,11 @@ namespace cight {
     \brief Abstract superclass for sensor feeds.
     */
     typedef boost::function<cv::Mat()> SensorStream;
+
+    /**
+    \brief Random-access frame feed: returns the frame at the given index, or an empty image if there is none.
+    */
+    typedef boost::function<cv::Mat(int)> FrameSource;
 }
 
 #endif
@@ -28,6 +28,23 @@ along with Cight. If not, see <http://www.gnu.org/licenses/>.
 #define WAIT_KEY_MS 200
 //#define WAIT_KEY_MS
 
+// Working set size targeted when evaluating feature maps against teach windows in
+// tiles, in bytes. Should fit comfortably in the L2 cache.
+#define TILE_CACHE_BYTES 262144
+
+// Smallest half-width, in rows, of the band of similarity cells computed around a
+// fitted line when banded similarity maps are enabled.
+#define BAND_MIN_RADIUS 2
+
+// Period, in replay columns, of the columns still computed over the whole teach
+// window when banded similarity maps are enabled. Line confidence is measured over
+// those columns only, so it reflects evidence the band did not select.
+#define BAND_PROBE_PERIOD 4
+
+// Smallest half-width, in rows, of the band refined at full resolution around a
+// line fitted over a coarse similarity map.
+#define PYRAMID_BAND_RADIUS 3
+
 #ifdef DIAGNOSTICS
 #include <iostream>
 #define LOG(message) std::cerr << message << std::endl;
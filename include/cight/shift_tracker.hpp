@@ -0,0 +1,85 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIGHT_SHIFT_TRACKER_HPP
+#define CIGHT_SHIFT_TRACKER_HPP
+
+#include <opencv2/opencv.hpp>
+
+namespace cight {
+    struct ShiftTracker;
+}
+
+/**
+\brief Tracks the horizontal shift between replay and teach views, to narrow feature searches.
+
+The tracker is fed the displacement vectors produced when feature maps are evaluated
+(see <tt>FeatureMap::operator () (window, ...)</tt>). Their median is taken as the
+measured shift, which is used to update a prediction and an estimate of its error.
+
+The search radius shrinks as the error estimate drops, down to a given minimum; if a
+measurement falls at or beyond the edge of the current search area, tracking is
+considered lost, and the radius is widened back to the full padding.
+*/
+struct cight::ShiftTracker {
+    /** \brief Predicted horizontal shift, in pixels. */
+    float shift;
+
+    /** \brief Estimated prediction error, in pixels. Negative if unknown. */
+    float error;
+
+    /** \brief Smallest search radius allowed. */
+    int minimum;
+
+    /** \brief Weight given to new measurements when updating estimates. */
+    float gain;
+
+    /** \brief Multiple of the error estimate searched around the prediction. */
+    float spread;
+
+    /** \brief Radius used in the last search, or a negative value if it used the full padding. */
+    int last;
+
+    /**
+    \brief Creates a new tracker with given parameters.
+    */
+    ShiftTracker(int minimum = 2, float gain = 0.5, float spread = 3.0);
+
+    /**
+    \brief Returns the predicted shift, rounded to the nearest pixel.
+    */
+    int offset() const;
+
+    /**
+    \brief Returns the search radius to use, given the full search padding.
+    */
+    int radius(int padding);
+
+    /**
+    \brief Updates the tracker with the displacement vector of an evaluated feature map.
+    */
+    void update(const cv::Mat &displacements);
+
+    /**
+    \brief Discards the current estimates, widening the search back to the full padding.
+    */
+    void reset();
+};
+
+#endif
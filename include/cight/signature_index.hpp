@@ -0,0 +1,116 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIGHT_SIGNATURE_INDEX_HPP
+#define CIGHT_SIGNATURE_INDEX_HPP
+
+#include <cight/route_file.hpp>
+#include <cight/sensor_stream.hpp>
+
+#include <clarus/core/list.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+namespace cight {
+    class SignatureIndex;
+}
+
+/**
+\brief Global index of compact per-frame signatures over a teach route, used to relocalize replays.
+
+Each teach frame is summarized by the column histogram (see <tt>column_histogram()</tt>)
+of its Sobel edge map, normalized to zero mean and unit length, so the dot product of
+two signatures is their correlation. Signatures are stored as the rows of a single
+contiguous matrix, and a query scores all of them at once with a matrix product.
+
+Queries take a short sequence of replay edge maps rather than a single one: every
+teach offset is scored by the mean correlation of the sequence against the teach
+frames following it, which is much less ambiguous than single frame matching along
+routes with repetitive scenery.
+*/
+class cight::SignatureIndex {
+    /** \brief Number of column bins in each signature. */
+    size_t bins;
+
+    /** \brief Teach frame signatures, one per row. */
+    cv::Mat signatures;
+
+public:
+    /**
+    \brief Default constructor. Creates an empty index.
+    */
+    SignatureIndex();
+
+    /**
+    \brief Creates an empty index of signatures with the given number of bins.
+    */
+    SignatureIndex(size_t bins);
+
+    /**
+    \brief Creates an index of all frames in the given teach stream.
+    */
+    SignatureIndex(SensorStream stream, size_t bins);
+
+    /**
+    \brief Creates an index of all frames in the given route's <tt>ROUTE_EDGES</tt> layer.
+
+    Signature rows match route frame indices, so query results can be used to seek
+    teach streams reading from the route.
+    */
+    SignatureIndex(const RouteFile &route, size_t bins);
+
+    /**
+    \brief Returns the signature of the given edge map, as a <tt>1 x bins</tt> \c CV_32F matrix.
+    */
+    static cv::Mat signature(const cv::Mat &edges, size_t bins);
+
+    /**
+    \brief Appends the signature of the given edge map to the index.
+    */
+    void append(const cv::Mat &edges);
+
+    /**
+    \brief Returns the number of indexed frames.
+    */
+    size_t size() const;
+
+    /**
+    \brief Returns whether the index is empty.
+    */
+    bool empty() const;
+
+    /**
+    \brief Returns the offsets of the \c k teach frames best matching the start of the given edge map sequence.
+
+    Offsets are sorted from best to worst, and are at least \c spacing frames apart
+    from each other, so candidates are distinct places along the route rather than
+    neighbours of the same one. If \c scores is given, it receives the score of each
+    returned offset, between -1 and 1.
+    */
+    std::vector<int> nearest(
+        const clarus::List<cv::Mat> &edges,
+        size_t k,
+        int spacing = 1,
+        std::vector<float> *scores = NULL
+    ) const;
+};
+
+#endif
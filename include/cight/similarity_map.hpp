@@ -23,13 +23,47 @@ along with Cight. If not, see <http://www.gnu.org/licenses/>.
 #include <cight/stream_teach.hpp>
 #include <cight/stream_replay.hpp>
 
+#include <clarus/core/list.hpp>
+
 #include <opencv2/opencv.hpp>
 
+#include <vector>
+
 namespace cight {
     struct SimilarityMap;
 }
 
 struct cight::SimilarityMap: public cv::Mat {
+    /** \brief Feature similarity matrices of each replay column, kept across updates. */
+    clarus::List<cv::Mat> cells;
+
+    /** \brief Best-match offsets of each replay column, kept across updates. */
+    clarus::List<cv::Mat> offsets;
+
+    /** \brief Mask of the cells evaluated in each replay column. */
+    clarus::List<cv::Mat> evaluated;
+
+    /** \brief Search shift (x) and radius (y) each replay column's cells were computed with. */
+    clarus::List<cv::Point> searches;
+
+    /** \brief Whether each replay column is computed over the whole window (nonzero) rather than a band. */
+    clarus::List<int> probes;
+
+    /** \brief Number of banded columns added since the last probe column. */
+    int since;
+
+    /** \brief Maximum half-width of the band of rows computed around the predicted line, or 0 to compute all rows. */
+    int band;
+
+    /** \brief Half-width of the band used on the next update, or -1 if no line was fitted yet. */
+    int radius;
+
+    /** \brief Line fitted over the map, moved along with it as the map shifts. */
+    cv::Point3f predicted;
+
+    /** \brief Confidence of the fitted line, measured over probe columns only (see <tt>fit()</tt>). */
+    float confidence;
+
     /**
     \brief Default constructor.
     */
@@ -47,8 +81,77 @@ struct cight::SimilarityMap: public cv::Mat {
 
     /**
     \brief Updates the similarity map with data from the given streams.
+
+    Only cells involving new frames are computed: the new teach rows against the
+    replay columns already in the map, and the new replay columns against all rows.
+    Once a line is fitted, columns are limited to the band around it if enabled.
+    Every column is then tallied again, so existing columns reflect the new rows.
+
+    New replay columns are searched around the shift predicted by the replay
+    stream's tracker, which is then updated with their displacements; each column
+    keeps that search on later updates.
+
+    Returns \c false if either stream runs out. Columns for the replay frames read
+    before that are still filled.
     */
     bool update(StreamTeach &teach, StreamReplay &replay);
+
+    /**
+    \brief Records the line fitted over the map.
+
+    If banding is enabled, later updates compute only cells within \c radius rows of
+    the line, with \c radius shrinking from \c band as the line's confidence grows.
+    Every <tt>BAND_PROBE_PERIOD</tt>-th new column is still computed over the whole
+    window, and confidence is measured over those probe columns only: a band holds
+    most of its column's response whether the line is right or not, so confidence
+    measured over banded columns could not drop far enough to widen the band again.
+    */
+    void fit(const cv::Point3f &line);
+
+    /**
+    \brief Marks replay columns up to \c columns as banded or probe columns, as they are added.
+
+    While no band is in use every column is a probe; afterwards, one column in every
+    <tt>BAND_PROBE_PERIOD</tt>, or in every map width if the map is narrower.
+    */
+    void markProbes(int columns);
+
+    /**
+    \brief Returns the range of rows to compute in each column, or an empty list to compute all rows.
+
+    Probe columns always span all rows.
+    */
+    std::vector<cv::Range> bands() const;
+
+    /**
+    \brief Changes the map's dimensions, keeping cells aligned to the most recent frames.
+
+    Cells are kept anchored to the bottom-right corner, where the latest teach and
+    replay frames are; rows and columns are dropped from, or added to, the top and
+    left. Streams must be resized to match before the next update.
+    */
+    void resizeWindow(const cv::Size &size);
 };
 
+namespace cight {
+    /**
+    \brief Returns a copy of the given matrix resized to the given dimensions, keeping its bottom-right corner in place.
+    */
+    cv::Mat anchorCorner(const cv::Mat &matrix, int rows, int cols);
+
+    /**
+    \brief Returns the similarity window size suited to the given fitted line.
+
+    The replay window (width) shrinks toward the minimum as \c confidence approaches
+    1, and grows toward the maximum as it approaches 0. The teach window (height) does
+    the same, but is never smaller than needed to span the replay window at the line's
+    slope. Both dimensions are clamped to the given bounds.
+
+    \c confidence must be measured over evidence not already narrowed around the line,
+    such as the probe columns of a banded map; otherwise it stays high and the window
+    never grows back.
+    */
+    cv::Size adaptWindow(const cv::Point3f &line, float confidence, const cv::Size &minimum, const cv::Size &maximum);
+}
+
 #endif
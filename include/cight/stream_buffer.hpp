@@ -64,6 +64,11 @@ struct cight::StreamBuffer {
     If the maximum buffer size is reached, the buffer's first item is discarded.
     */
     virtual bool read();
+
+    /**
+    \brief Changes the maximum buffer size, discarding the oldest items that no longer fit.
+    */
+    virtual void resize(size_t size);
 };
 
 #endif
@@ -23,6 +23,7 @@ along with Cight. If not, see <http://www.gnu.org/licenses/>.
 #include <cight/difference_stream.hpp>
 #include <cight/feature_map.hpp>
 #include <cight/feature_selector.hpp>
+#include <cight/shift_tracker.hpp>
 #include <cight/stream_teach.hpp>
 
 namespace cight {
@@ -42,6 +43,20 @@ struct cight::StreamReplay: public DifferenceStream {
     /** \brief Padding for feature points. */
     int padding;
 
+    /**
+    \brief Whether to compute full similarity maps.
+
+    If \c false (the default) and the teach window uses the \c DIRECT comparator,
+    correlations that cannot affect the similarity vector are skipped, and similarity
+    maps are only partially filled (see <tt>FeatureMap::prune()</tt>). Set to \c true
+    to get complete maps, e.g. for diagnostics. Other comparators always fill the
+    maps.
+    */
+    bool exact;
+
+    /** \brief Tracker of the horizontal shift between replay and teach views, used to narrow feature searches. */
+    ShiftTracker tracker;
+
     /**
     \brief Default constructor.
     */
@@ -60,9 +75,20 @@ struct cight::StreamReplay: public DifferenceStream {
 
     /**
     \brief Returns the similarities between the given replay image and the current contents of the teach buffer.
+
+    Feature searches are centered on the shift predicted by the tracker, which is then
+    updated with the resulting displacements.
     */
     clarus::List<cv::Mat> operator () (int j, StreamTeach &teach);
 
+    /**
+    \brief Returns the similarities between replay images <tt>[j0, j1)</tt> and the current contents of the teach buffer.
+
+    Results are the same as those of calling <tt>operator () (j, teach)</tt> for each
+    image, but are computed in a single batch (see <tt>evaluateBatch()</tt>).
+    */
+    clarus::List<clarus::List<cv::Mat> > operator () (int j0, int j1, StreamTeach &teach);
+
     virtual void pop();
 
     virtual bool read();
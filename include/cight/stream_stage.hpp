@@ -0,0 +1,241 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIGHT_STREAM_STAGE_HPP
+#define CIGHT_STREAM_STAGE_HPP
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <deque>
+
+namespace cight {
+    template<class T> class BoundedQueue;
+
+    template<class T> class StreamStage;
+}
+
+/**
+\brief A thread-safe FIFO queue of limited capacity.
+
+Producers block while the queue is full, and consumers while it is empty. Once the
+queue is closed, pushes fail immediately, and pops fail as soon as the queue is
+drained.
+*/
+template<class T> class cight::BoundedQueue {
+    /** \brief Queued items. */
+    std::deque<T> items;
+
+    /** \brief Maximum number of queued items. */
+    size_t limit;
+
+    /** \brief Whether the queue has been closed. */
+    bool closed;
+
+    /** \brief Lock guarding all state. */
+    mutable boost::mutex lock;
+
+    /** \brief Signalled when an item is pushed, or the queue is closed. */
+    boost::condition_variable pushed;
+
+    /** \brief Signalled when an item is popped, or the queue is closed. */
+    boost::condition_variable popped;
+
+public:
+    /**
+    \brief Creates a new queue of given capacity.
+    */
+    BoundedQueue(size_t capacity):
+        limit(capacity > 0 ? capacity : 1),
+        closed(false)
+    {
+        // Nothing to do.
+    }
+
+    /**
+    \brief Adds an item to the end of the queue, waiting for room if necessary.
+
+    Returns \c false if the queue was closed before the item could be added.
+    */
+    bool push(const T &item) {
+        boost::unique_lock<boost::mutex> guard(lock);
+        while (!closed && items.size() >= limit) {
+            popped.wait(guard);
+        }
+
+        if (closed) {
+            return false;
+        }
+
+        items.push_back(item);
+        pushed.notify_one();
+        return true;
+    }
+
+    /**
+    \brief Removes the first item of the queue, waiting for one if necessary.
+
+    Returns \c false if the queue is closed and empty.
+    */
+    bool pop(T &item) {
+        boost::unique_lock<boost::mutex> guard(lock);
+        while (!closed && items.empty()) {
+            pushed.wait(guard);
+        }
+
+        if (items.empty()) {
+            return false;
+        }
+
+        item = items.front();
+        items.pop_front();
+        popped.notify_one();
+        return true;
+    }
+
+    /**
+    \brief Closes the queue, waking up all waiting producers and consumers.
+    */
+    void close() {
+        boost::unique_lock<boost::mutex> guard(lock);
+        closed = true;
+        pushed.notify_all();
+        popped.notify_all();
+    }
+
+    /**
+    \brief Returns the number of queued items.
+    */
+    size_t size() const {
+        boost::unique_lock<boost::mutex> guard(lock);
+        return items.size();
+    }
+
+    /**
+    \brief Returns the maximum number of queued items.
+    */
+    size_t capacity() const {
+        return limit;
+    }
+};
+
+/**
+\brief A pipeline stage that produces items on its own thread.
+
+The stage repeatedly calls a source function on a background thread, pushing each
+produced item into a bounded queue, until the source reports it is exhausted.
+Consumers pop items in production order, so the sequence of items is the same as if
+the source were called directly.
+
+Copies of a stage share the same thread and queue. The thread is stopped when the last
+copy is destroyed; if it is blocked inside the source function, destruction waits for
+that call to return.
+*/
+template<class T> class cight::StreamStage {
+public:
+    /**
+    \brief Type of functions producing stage items. Return \c false when no more items are available.
+    */
+    typedef boost::function<bool(T&)> Source;
+
+private:
+    struct State {
+        /** \brief Produced items waiting to be consumed. */
+        BoundedQueue<T> queue;
+
+        /** \brief Item source. */
+        Source source;
+
+        /** \brief Producer thread. */
+        boost::thread thread;
+
+        State(Source _source, size_t depth):
+            queue(depth),
+            source(_source)
+        {
+            // Nothing to do.
+        }
+
+        ~State() {
+            queue.close();
+            thread.join();
+        }
+
+        void run() {
+            for (;;) {
+                T item;
+                if (!source(item) || !queue.push(item)) {
+                    break;
+                }
+            }
+
+            queue.close();
+        }
+    };
+
+    /** \brief Shared stage state, or null if the stage is inactive. */
+    boost::shared_ptr<State> state;
+
+public:
+    /**
+    \brief Default constructor. Creates an inactive stage.
+    */
+    StreamStage() {
+        // Nothing to do.
+    }
+
+    /**
+    \brief Creates a new stage drawing items from the given source, queueing up to \c depth of them.
+
+    The producer thread is started immediately.
+    */
+    StreamStage(Source source, size_t depth):
+        state(new State(source, depth))
+    {
+        state->thread = boost::thread(&State::run, state.get());
+    }
+
+    /**
+    \brief Retrieves the next item, waiting for it to be produced if necessary.
+
+    Returns \c false if the source is exhausted.
+    */
+    bool operator () (T &item) {
+        return state->queue.pop(item);
+    }
+
+    /**
+    \brief Returns whether this stage is running (i.e. was not default-constructed).
+    */
+    bool active() const {
+        return state.get() != NULL;
+    }
+
+    /**
+    \brief Returns the number of produced items waiting to be consumed.
+    */
+    size_t depth() const {
+        return (active() ? state->queue.size() : 0);
+    }
+};
+
+#endif
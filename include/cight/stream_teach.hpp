@@ -21,6 +21,7 @@ along with Cight. If not, see <http://www.gnu.org/licenses/>.
 #define CIGHT_STREAM_TEACH_HPP
 
 #include <cight/difference_stream.hpp>
+#include <cight/teach_window.hpp>
 
 namespace cight {
     struct StreamTeach;
@@ -30,6 +31,15 @@ namespace cight {
 \brief Teach step memory pipeline.
 */
 struct cight::StreamTeach: public DifferenceStream {
+    /**
+    \brief Difference images packed into a contiguous buffer.
+
+    Unless the window uses the \c CENSUS comparator (in which case it stores census
+    transforms), the window is the only copy of the difference images: the entries of
+    <tt>diffs</tt> are views into it.
+    */
+    TeachWindow window;
+
     /** \brief Additional padding to search for good matches. */
     int padding;
 
@@ -40,8 +50,36 @@ struct cight::StreamTeach: public DifferenceStream {
 
     /**
     \brief Creates a new teach step memory pipeline.
+
+    The given comparator selects how replay feature points are compared to the
+    difference images in the teach window.
+    */
+    StreamTeach(SensorStream stream, size_t size, double threshold, int padding, Comparator comparator = CORRELATION);
+
+    /**
+    \brief Creates a new teach step memory pipeline reading from a precomputed route.
+    */
+    StreamTeach(const RouteFile &route, size_t size, int padding, Comparator comparator = CORRELATION);
+
+    /**
+    \brief Discards the buffer's first item.
+    */
+    virtual void pop();
+
+    /**
+    \brief Read a single frame from the input stream.
+
+    The new difference image is moved to the teach window, and its entry in
+    <tt>diffs</tt> replaced by a view into the window.
+    */
+    virtual bool read();
+
+    /**
+    \brief Changes the maximum number of difference images, resizing the teach window along.
+
+    Since resizing repacks the window, the views in <tt>diffs</tt> are updated.
     */
-    StreamTeach(SensorStream stream, size_t size, double threshold, int padding);
+    virtual void resize(size_t size);
 };
 
 #endif
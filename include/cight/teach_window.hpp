@@ -0,0 +1,295 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIGHT_TEACH_WINDOW_HPP
+#define CIGHT_TEACH_WINDOW_HPP
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+namespace cight {
+    class TeachWindow;
+
+    /**
+    \brief Ways of comparing feature point patches to teach frames.
+    */
+    enum Comparator {
+        /** \brief Fourier cross-correlation of patch and neighborhood, as by <tt>FeaturePoint::operator ()</tt>. */
+        CORRELATION,
+
+        /** \brief Hamming distance between census transforms of patch and frame. */
+        CENSUS,
+
+        /** \brief Unnormalized dot product of patch and frame values, over positions where the patch fits entirely; integer for 8-bit inputs. */
+        DIRECT
+    };
+}
+
+/**
+\brief A fixed-capacity window of teach frames, stored as one contiguous buffer.
+
+Frames are kept as slices of a single <tt>capacity &times; rows &times; cols</tt>
+buffer, managed as a ring: appending to a full window overwrites the oldest slice.
+Frame rows are padded to a multiple of 16 bytes, and all frames must share the size
+and type of the first one appended.
+
+Windows using the \c CENSUS comparator store the census transforms of appended
+frames (see <tt>census()</tt>) instead of the frames themselves.
+
+The integral image of squared values of a frame, used to look up the energy of any
+frame region in constant time, is computed the first time it is requested and kept
+until the frame is discarded. Since only pruned correlation needs it, windows that
+are never pruned never pay for it. The cache is not synchronized: a window should
+not be pruned against from several threads at once.
+
+Copies of a window are deep: each copy owns its own buffer.
+*/
+class cight::TeachWindow {
+    /** \brief Frame buffer, one block of rows per slice. */
+    cv::Mat buffer;
+
+    /** \brief Integral images of squared frame values, one block of rows per slice. */
+    mutable cv::Mat squares;
+
+    /** \brief Whether each slice's integral image in <tt>squares</tt> is up to date. */
+    mutable std::vector<bool> integrated;
+
+    /** \brief Maximum number of frames. */
+    size_t slots;
+
+    /** \brief Slice holding the oldest frame. */
+    size_t origin;
+
+    /** \brief Number of frames currently stored. */
+    size_t count;
+
+    /** \brief Size of stored frames. */
+    cv::Size frame;
+
+    /** \brief How feature point patches are compared to stored frames. */
+    Comparator method;
+
+public:
+    /**
+    \brief Default constructor. Creates a window of zero capacity.
+    */
+    TeachWindow();
+
+    /**
+    \brief Creates a new window of given capacity and comparator.
+    */
+    TeachWindow(size_t capacity, Comparator comparator = CORRELATION);
+
+    /**
+    \brief Copy constructor.
+    */
+    TeachWindow(const TeachWindow &that);
+
+    /**
+    \brief Copy assignment.
+    */
+    TeachWindow &operator = (const TeachWindow &that);
+
+    /**
+    \brief Copies the given frame to the end of the window.
+
+    If the window is full, the oldest frame is discarded.
+    */
+    void append(const cv::Mat &image);
+
+    /**
+    \brief Discards the oldest frame.
+    */
+    void pop();
+
+    /**
+    \brief Discards all frames.
+    */
+    void clear();
+
+    /**
+    \brief Changes the maximum number of frames.
+
+    If the window holds more frames than the new capacity, the oldest are discarded.
+    */
+    void resize(size_t capacity);
+
+    /**
+    \brief Returns the <tt>i</tt>-th oldest frame, as a view into the buffer.
+
+    Negative indices count from the end of the window, so <tt>at(-1)</tt> is the
+    newest frame.
+    */
+    cv::Mat at(int i) const;
+
+    /**
+    \brief Returns a pointer to the first byte of the <tt>i</tt>-th oldest frame.
+    */
+    const uchar *data(int i) const;
+
+    /**
+    \brief Returns the integral image of squared values of the <tt>i</tt>-th oldest frame.
+
+    The returned matrix is of type \c CV_64F and one row and column larger than the
+    frame. It is computed on the first call for each frame.
+    */
+    cv::Mat integralSquares(int i) const;
+
+    /**
+    \brief Returns the distance in bytes between successive rows of a frame.
+    */
+    size_t step() const;
+
+    /**
+    \brief Returns the comparator used with this window.
+    */
+    Comparator comparator() const;
+
+    /**
+    \brief Returns the type of stored frames.
+    */
+    int type() const;
+
+    /**
+    \brief Returns the size of stored frames.
+    */
+    cv::Size frameSize() const;
+
+    /**
+    \brief Returns the number of frames currently stored.
+    */
+    size_t size() const;
+
+    /**
+    \brief Returns the maximum number of frames.
+    */
+    size_t capacity() const;
+
+    /**
+    \brief Returns whether the window is empty.
+    */
+    bool empty() const;
+};
+
+namespace cight {
+    /**
+    \brief Correlates a patch against the same neighborhood of a range of teach frames, in the Fourier domain.
+
+    For each frame <tt>i &isin; [i0, n)</tt> of the window, the neighborhood is
+    cross-correlated with the patch by <tt>fourier::correlate()</tt>, and the maximum
+    response is written to <tt>peaks.at<float>(i, column)</tt>. This is the same
+    value <tt>FeaturePoint::operator ()</tt> yields, with the same border handling.
+
+    If \c offsets is given, the horizontal image coordinate of each frame's response
+    peak is written to <tt>offsets->at<int>(i, column)</tt>.
+
+    If \c first is given, each frame's results go to row <tt>i - first</tt> of
+    \c peaks and \c offsets instead, so they need only span the evaluated frames.
+    */
+    void correlateFourier(
+        const cv::Mat &patch,
+        const TeachWindow &window,
+        const cv::Rect &neighborhood,
+        int i0,
+        int n,
+        cv::Mat &peaks,
+        int column,
+        cv::Mat *offsets = NULL,
+        int first = 0
+    );
+
+    /**
+    \brief Correlates a patch against the same neighborhood of a range of teach frames.
+
+    This is the kernel of the \c DIRECT comparator.
+
+    For each frame <tt>i &isin; [i0, n)</tt> of the window, the patch is slid over
+    every position of the given neighborhood where it fits entirely, and the maximum
+    of the dot products between patch and image is written to
+    <tt>peaks.at<float>(i, column)</tt>.
+
+    All frames are evaluated in a single pass over the neighborhood: the inner loop
+    runs over frames, so every patch value is loaded once per position and the
+    accumulators for all frames stay in cache.
+
+    If \c offsets is given, the horizontal image coordinate of the patch's left border
+    at each frame's peak is written to <tt>offsets->at<int>(i, column)</tt>. Rows are
+    moved up by \c first, as in <tt>correlateFourier()</tt>.
+
+    Patch and frames must be single-channel, but need not share the same depth.
+
+    If \c peaks is of type \c CV_32S, patch and frames must be \c CV_8U, and the
+    correlation is computed in integer arithmetic (with SSE2 multiply-adds where
+    available); otherwise \c peaks must be \c CV_32F.
+    */
+    void correlateWindow(
+        const cv::Mat &patch,
+        const TeachWindow &window,
+        const cv::Rect &neighborhood,
+        int i0,
+        int n,
+        cv::Mat &peaks,
+        int column,
+        cv::Mat *offsets = NULL,
+        int first = 0
+    );
+}
+
+namespace cight {
+    /**
+    \brief Compares a census-coded patch against the same neighborhood of a range of census teach frames.
+
+    Works as <tt>correlateWindow()</tt>, except the score at each position is the number
+    of equal bits between patch and frame codes (i.e. the number of bits minus their
+    Hamming distance), computed with hardware population counts where available.
+
+    The patch must be of type \c CV_8U, as returned by <tt>census()</tt>.
+    */
+    void matchCensus(
+        const cv::Mat &codes,
+        const TeachWindow &window,
+        const cv::Rect &neighborhood,
+        int i0,
+        int n,
+        cv::Mat &peaks,
+        int column,
+        cv::Mat *offsets = NULL,
+        int first = 0
+    );
+
+    /**
+    \brief Returns an upper bound on the correlation peak of a patch over a frame neighborhood.
+
+    By the Cauchy&ndash;Schwarz inequality, the dot product of the patch and any
+    equally-sized region is at most the product of their L2 norms. The bound is the
+    patch norm times the largest region norm among all positions of a patch of given
+    size inside the neighborhood of the <tt>i</tt>-th frame, as computed from the
+    window's integral images.
+    */
+    float correlationBound(
+        float norm,
+        const cv::Size &patch,
+        const TeachWindow &window,
+        const cv::Rect &neighborhood,
+        int i
+    );
+}
+
+#endif
@@ -1,13 +1,22 @@
 #ifndef DEJAVU_TRANSFORMS_HPP
 #define DEJAVU_TRANSFORMS_HPP
 
+#include <cight/frame.hpp>
+
 #include <opencv2/opencv.hpp>
 
 namespace cight {
     /*
-    Returns a binary edge map of the input BGR image.
+    Returns a binary edge map of the input frame, computed from its Sobel edge map.
+    */
+    cv::Mat binary_edges(const Frame &frame);
+
+    /*
+    Returns the census transform of a single-channel image: each pixel of the (CV_8U)
+    output holds one bit per 8-connected neighbor, set if the neighbor is lower than
+    the pixel. Image borders are replicated.
     */
-    cv::Mat binary_edges(const cv::Mat &bgr);
+    cv::Mat census(const cv::Mat &image);
 
     /*
     Returns the vector of pixel sums over (bins) columns of equal width for the given
@@ -24,13 +24,25 @@ along with Cight. If not, see <http://www.gnu.org/licenses/>.
 #include <cight/feature_selector.hpp>
 #include <cight/interpolator.hpp>
 #include <cight/memory.hpp>
+#include <cight/route_file.hpp>
 #include <cight/sensor_stream.hpp>
 #include <cight/settings.hpp>
+#include <cight/shift_tracker.hpp>
+#include <cight/signature_index.hpp>
+#include <cight/similarity_map.hpp>
 #include <cight/stream_buffer.hpp>
+#include <cight/stream_stage.hpp>
+#include <cight/teach_window.hpp>
 
 #include <clarus/core/list.hpp>
 
+#include <vector>
+
 namespace cight {
+    struct TeachFrameV;
+
+    struct ReplayFrameV;
+
     struct StreamTeachV;
 
     struct StreamReplayV;
@@ -40,16 +52,59 @@ namespace cight {
     struct VisualMatcher;
 }
 
+/**
+\brief A teach frame, preprocessed for matching.
+*/
+struct cight::TeachFrameV {
+    /** \brief Grayscale version of the frame. */
+    cv::Mat gray;
+
+    /** \brief Edge map of the frame. */
+    cv::Mat edges;
+
+    /** \brief Edge map of a reduced level of the frame's pyramid, if coarse matching is enabled. */
+    cv::Mat coarse;
+};
+
+/**
+\brief A replay frame, together with the feature map selected from it.
+*/
+struct cight::ReplayFrameV {
+    /** \brief Grayscale version of the frame. */
+    cv::Mat gray;
+
+    /** \brief Feature points selected from the frame. */
+    FeatureMap features;
+
+    /** \brief The same feature points at a reduced pyramid level, if coarse matching is enabled. */
+    FeatureMap reduced;
+};
+
 /**
 \brief Teach step memory pipeline.
 */
 struct cight::StreamTeachV: public StreamBuffer {
     /** \brief Memory buffer for the teach stream edge maps. */
-    clarus::List<cv::Mat> edges;
+    TeachWindow edges;
 
     /** \brief Additional padding to search for good matches. */
     int padding;
 
+    /** \brief Pyramid level of the coarse edge maps, or 0 if coarse matching is disabled. */
+    int levels;
+
+    /** \brief Memory buffer for coarse edge maps, mirroring <tt>edges</tt> at pyramid level <tt>levels</tt>. */
+    TeachWindow coarse;
+
+    /** \brief Background stage reading and preprocessing frames, if pipelining is enabled. */
+    StreamStage<TeachFrameV> stage;
+
+    /** \brief Precomputed route to read frames and edge maps from, instead of the input stream. */
+    RouteFile route;
+
+    /** \brief Index of the next route frame to read. */
+    size_t cursor;
+
     /**
     \brief Default constructor.
     */
@@ -59,9 +114,20 @@ struct cight::StreamTeachV: public StreamBuffer {
     \brief Creates a new teach step memory pipeline.
 
     The pipeline is bound to the given input stream, and internal buffers store
-    items up to the given size.
+    items up to the given size. The given comparator selects how replay feature
+    points are compared to the teach edge maps.
+    */
+    StreamTeachV(SensorStream stream, size_t size, int padding, Comparator comparator = CORRELATION);
+
+    /**
+    \brief Creates a new teach step memory pipeline reading from a precomputed route.
+
+    Frames and edge maps are views of the route's <tt>ROUTE_GRAY</tt> and
+    <tt>ROUTE_EDGES</tt> layers, so teach frames are neither decoded nor filtered.
+    If coarse matching is enabled, the route must include coarse edge maps of the
+    same pyramid level.
     */
-    StreamTeachV(SensorStream stream, size_t size, int padding);
+    StreamTeachV(const RouteFile &route, size_t size, int padding, Comparator comparator = CORRELATION);
 
     /**
     Discards the first item of each internal buffer.
@@ -75,6 +141,32 @@ struct cight::StreamTeachV: public StreamBuffer {
     maximum buffer size is reached, the first item of each buffer is discarded.
     */
     virtual bool read();
+
+    /**
+    \brief Changes the maximum number of frames, resizing the edge map window along.
+    */
+    virtual void resize(size_t size);
+
+    /**
+    \brief Starts reading and preprocessing frames on a background thread, up to \c depth frames ahead.
+
+    Frames are read in the same order and processed the same way, so results are
+    unchanged; only the work moves off the caller's thread. Does nothing if frames
+    are read from a precomputed route.
+    */
+    void pipeline(size_t depth);
+
+    /**
+    \brief Returns the number of frames preprocessed ahead and waiting to be read.
+    */
+    size_t queued() const;
+
+    /**
+    \brief Empties the buffers, so the next frame read is the route frame at offset \c k.
+
+    Throws <tt>std::runtime_error</tt> if frames are not read from a route.
+    */
+    void seek(size_t k);
 };
 
 /**
@@ -84,6 +176,12 @@ struct cight::StreamReplayV: public StreamBuffer {
     /** \brief Memory buffer for replay stream feature maps. */
     clarus::List<FeatureMap> maps;
 
+    /** \brief Pyramid level of the coarse feature maps, or 0 if coarse matching is disabled. */
+    int levels;
+
+    /** \brief Memory buffer for coarse feature maps, mirroring <tt>maps</tt> at pyramid level <tt>levels</tt>. */
+    clarus::List<FeatureMap> coarse;
+
     /** \brief Memory buffer for replay stream shift maps. */
     clarus::List<cv::Mat> shifts;
 
@@ -94,6 +192,23 @@ struct cight::StreamReplayV: public StreamBuffer {
     /** \brief Padding for feature points. */
     int padding;
 
+    /**
+    \brief Whether to compute full similarity maps.
+
+    If \c false (the default) and the teach window uses the \c DIRECT comparator,
+    correlations that cannot affect the similarity vector are skipped, and similarity
+    maps are only partially filled (see <tt>FeatureMap::prune()</tt>). Set to \c true
+    to get complete maps, e.g. for diagnostics. Other comparators always fill the
+    maps.
+    */
+    bool exact;
+
+    /** \brief Tracker of the horizontal shift between replay and teach views, used to narrow feature searches. */
+    ShiftTracker tracker;
+
+    /** \brief Background stage reading frames and selecting feature points, if pipelining is enabled. */
+    StreamStage<ReplayFrameV> stage;
+
     /**
     \brief Default constructor.
     */
@@ -109,9 +224,20 @@ struct cight::StreamReplayV: public StreamBuffer {
 
     /**
     \brief Returns the similarities between the given replay image and the current contents of the teach buffer.
+
+    Feature searches are centered on the shift predicted by the tracker, which is then
+    updated with the resulting displacements.
     */
     clarus::List<cv::Mat> operator () (int j, StreamTeachV &teach);
 
+    /**
+    \brief Returns the similarities between replay images <tt>[j0, j1)</tt> and the current contents of the teach buffer.
+
+    Results are the same as those of calling <tt>operator () (j, teach)</tt> for each
+    image, but are computed in a single batch (see <tt>evaluateBatch()</tt>).
+    */
+    clarus::List<clarus::List<cv::Mat> > operator () (int j0, int j1, StreamTeachV &teach);
+
     /**
     Discards the first item of each internal buffer.
     */
@@ -125,6 +251,19 @@ struct cight::StreamReplayV: public StreamBuffer {
     */
     virtual bool read();
 
+    /**
+    \brief Starts reading frames and selecting feature points on a background thread, up to \c depth frames ahead.
+
+    The selector is called on the background thread from then on, in the same order,
+    so results are unchanged.
+    */
+    void pipeline(size_t depth);
+
+    /**
+    \brief Returns the number of frames processed ahead and waiting to be read.
+    */
+    size_t queued() const;
+
     /**
     \brief Returns the shift vector between replay image \c i and teach image \c j.
     */
@@ -132,6 +271,51 @@ struct cight::StreamReplayV: public StreamBuffer {
 };
 
 struct cight::SimilarityMapV: public cv::Mat {
+    /** \brief Feature similarity matrices of each replay column, kept across updates. */
+    clarus::List<cv::Mat> cells;
+
+    /** \brief Best-match offsets of each replay column, kept across updates. */
+    clarus::List<cv::Mat> offsets;
+
+    /** \brief Mask of the cells evaluated in each replay column. */
+    clarus::List<cv::Mat> evaluated;
+
+    /** \brief Search shift (x) and radius (y) each replay column's cells were computed with. */
+    clarus::List<cv::Point> searches;
+
+    /** \brief Whether each replay column is computed over the whole window (nonzero) rather than a band. */
+    clarus::List<int> probes;
+
+    /** \brief Number of banded columns added since the last probe column. */
+    int since;
+
+    /** \brief Maximum half-width of the band of rows computed around the predicted line, or 0 to compute all rows. */
+    int band;
+
+    /** \brief Half-width of the band used on the next update, or -1 if no line was fitted yet. */
+    int radius;
+
+    /** \brief Line fitted over the map, moved along with it as the map shifts. */
+    cv::Point3f predicted;
+
+    /** \brief Confidence of the fitted line, measured over probe columns only (see <tt>fit()</tt>). */
+    float confidence;
+
+    /** \brief Coarse similarity map, computed from reduced teach and replay frames. */
+    cv::Mat rough;
+
+    /** \brief Feature similarity matrices of each replay column in the coarse map. */
+    clarus::List<cv::Mat> roughCells;
+
+    /** \brief Best-match offsets of each replay column in the coarse map. */
+    clarus::List<cv::Mat> roughOffsets;
+
+    /** \brief Mask of the cells evaluated in each coarse replay column. */
+    clarus::List<cv::Mat> roughEvaluated;
+
+    /** \brief Search shift (x) and radius (y) each coarse replay column's cells were computed with. */
+    clarus::List<cv::Point> roughSearches;
+
     /**
     \brief Default constructor.
     */
@@ -144,8 +328,66 @@ struct cight::SimilarityMapV: public cv::Mat {
 
     /**
     \brief Updates the similarity map with data from the given streams.
+
+    Only cells involving new frames are computed: the new teach rows against the
+    replay columns already in the map, and the new replay columns against all rows.
+    Once a line is fitted, columns are limited to the band around it if enabled.
+
+    New replay columns are searched around the shift predicted by the replay
+    stream's tracker, which is then updated with their displacements; each column
+    keeps that search on later updates.
+
+    If the streams keep coarse frames and a \c guide interpolator is given, the
+    whole window is first matched at the coarse level, and a line fitted over the
+    coarse map by \c guide. The full resolution map is then computed only in a band
+    around that line, at least <tt>PYRAMID_BAND_RADIUS</tt> rows wide on each side and
+    widening towards \c band as the coarse fit's confidence drops. Probe columns (see
+    <tt>markProbes()</tt>) are still computed over the whole window.
+
+    Returns \c false if either stream runs out. Columns for the replay frames read
+    before that are still filled.
+
+    \param ahead Number of replay frames already read into the buffer but not yet matched.
+    */
+    bool update(StreamTeachV &teach, StreamReplayV &replay, int ahead = 0, const Interpolator &guide = Interpolator());
+
+    /**
+    \brief Records the line fitted over the map.
+
+    If banding is enabled, later updates compute only cells within \c radius rows of
+    the line, with \c radius shrinking from \c band as the line's confidence grows.
+    Every <tt>BAND_PROBE_PERIOD</tt>-th new column is still computed over the whole
+    window, and confidence is measured over those probe columns only: a band holds
+    most of its column's response whether the line is right or not, so confidence
+    measured over banded columns could not drop far enough to widen the band again.
+    */
+    void fit(const cv::Point3f &line);
+
+    /**
+    \brief Marks replay columns up to \c columns as banded or probe columns, as they are added.
+
+    While no band is in use every column is a probe; afterwards, one column in every
+    <tt>BAND_PROBE_PERIOD</tt>, or in every map width if the map is narrower. A band is
+    in use once a line is fitted, or from the start if \c narrowed is set because a
+    coarse pass limits the columns instead.
+    */
+    void markProbes(int columns, bool narrowed = false);
+
+    /**
+    \brief Returns the range of rows to compute in each column, or an empty list to compute all rows.
+
+    Probe columns always span all rows.
+    */
+    std::vector<cv::Range> bands() const;
+
+    /**
+    \brief Changes the map's dimensions, keeping cells aligned to the most recent frames.
+
+    Cells are kept anchored to the bottom-right corner, where the latest teach and
+    replay frames are; rows and columns are dropped from, or added to, the top and
+    left. Streams must be resized to match before the next update.
     */
-    bool update(StreamTeachV &teach, StreamReplayV &replay);
+    void resizeWindow(const cv::Size &size);
 };
 
 struct cight::VisualMatcher {
@@ -167,6 +409,33 @@ struct cight::VisualMatcher {
     /** \brief Index of the next matching to return. */
     int index;
 
+    /**
+    \brief Whether matches are returned provisionally, ahead of line refits.
+
+    In provisional mode every call reads a single new replay frame and matches it by
+    extrapolating the current line; the refit including that frame is deferred to the
+    next call. Matches that the refit moves are reported through corrected().
+    */
+    bool provisional;
+
+    /** \brief Number of replay (x) and teach (y) frames discarded from the buffers so far. */
+    cv::Point dropped;
+
+    /** \brief Absolute replay (x) and teach (y) indices of the last returned match. */
+    cv::Point latest;
+
+    /** \brief Provisional matches not yet confirmed by a refit, as absolute (replay, teach) indices. */
+    clarus::List<cv::Point> unconfirmed;
+
+    /** \brief Provisional matches changed by a refit, as absolute (replay, provisional teach, corrected teach) indices. */
+    clarus::List<cv::Point3i> corrections;
+
+    /** \brief Smallest similarity window size, as replay (width) and teach (height) frame counts. */
+    cv::Size windowMin;
+
+    /** \brief Largest similarity window size. Windows adapt between the bounds unless they are equal. */
+    cv::Size windowMax;
+
     /**
     \brief Default constructor.
     */
@@ -188,6 +457,8 @@ struct cight::VisualMatcher {
     \param padding_b Additional padding for teach image patches.
 
     \param interpolator Function used to interpolate a stream matching line over the current similarity map.
+
+    \param comparator How feature point patches are compared to teach images.
     */
     VisualMatcher(
         SensorStream teach,
@@ -196,16 +467,112 @@ struct cight::VisualMatcher {
         Selector selector,
         int padding_a,
         int padding_b,
-        Interpolator interpolator
+        Interpolator interpolator,
+        Comparator comparator = CORRELATION
+    );
+
+    /**
+    \brief Creates a new stream matcher over a precomputed teach route.
+
+    Parameters are the same as for the constructor above, except teach frames and
+    edge maps are read from \c route instead of computed from a video stream.
+    */
+    VisualMatcher(
+        const RouteFile &route,
+        SensorStream replay,
+        const cv::Size &window,
+        Selector selector,
+        int padding_a,
+        int padding_b,
+        Interpolator interpolator,
+        Comparator comparator = CORRELATION
     );
 
     // See cight::StreamMatcher
     clarus::List<cv::Mat> operator() ();
 
+    /**
+    \brief Enables coarse-to-fine matching over the given pyramid level.
+
+    Teach edge maps and replay feature points are also kept at pyramid level \c levels,
+    and each update first fits the matching line over a coarse similarity map,
+    refining at full resolution only within \c band rows around it (see
+    <tt>SimilarityMapV::update()</tt>), which also enables banding around the fitted
+    line. Must be called before any frames are read, and before <tt>pipeline()</tt>.
+    */
+    void coarseToFine(int levels, int band);
+
+    /**
+    \brief Moves teach frame preprocessing and replay feature selection to background threads.
+
+    Each stream is read up to \c depth frames ahead of the matcher, so the next replay
+    frame's features are selected while the current similarity columns are computed.
+    Matching results are the same as in sequential operation. Feature map evaluation
+    and interpolation stay on the caller's thread, since each depends on the streams'
+    state as left by the previous call.
+    */
+    void pipeline(size_t depth);
+
+    /**
+    \brief Returns the number of frames waiting in the teach and replay stages, in this order.
+    */
+    std::vector<size_t> queued() const;
+
+    /**
+    \brief Restarts matching with the teach window starting at the given route frame.
+
+    The similarity map, matching line and shift tracker are discarded, and rebuilt
+    on the next call from the teach frames at \c offset and the replay frames already
+    buffered. The teach stream must read from a route. Not supported in provisional
+    mode.
+    */
+    void seek(size_t offset);
+
+    /**
+    \brief Finds the replay's place along the teach route, and restarts matching from there.
+
+    The replay buffer is filled if necessary, and its frames queried against the given
+    index of the teach route (see <tt>SignatureIndex::nearest()</tt>). The teach window
+    is then seeded at the best candidate offset.
+
+    Returns up to \c k candidate offsets, best first, at least a teach window apart, or
+    an empty vector if there were not enough replay frames to query with.
+    */
+    std::vector<int> relocalize(const SignatureIndex &index, size_t k = 1);
+
+    /**
+    \brief Returns the provisional matches changed by refits since the last call, and clears them.
+    */
+    clarus::List<cv::Point3i> corrected();
+
     /**
     \brief Compute the matching trend between streams.
+
+    \param ahead Number of replay frames read ahead of the similarity map.
+    */
+    bool computeMatching(int ahead = 0);
+
+    /**
+    \brief Resizes the teach and replay windows to suit the current line and its confidence.
+
+    Windows shrink on well-tracked segments and grow back when the fit degrades; see
+    <tt>adaptWindow()</tt>. The fit is judged by the similarity map's confidence,
+    which is measured over unbanded probe columns (see <tt>fit()</tt>), so it drops
+    when the line drifts off even while banding is on. Nothing happens if the window
+    bounds are equal.
+    */
+    void adapt();
+
+private:
+    /**
+    \brief Returns the next match in provisional mode.
+    */
+    clarus::List<cv::Mat> extrapolate();
+
+    /**
+    \brief Refits the matching line over frames read ahead, recording corrections to provisional matches.
     */
-    bool computeMatching();
+    bool confirm();
 };
 
 #endif
@@ -0,0 +1,296 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cight/batch_matcher.hpp>
+using cight::BatchMatcher;
+using clarus::List;
+
+#include <cight/settings.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+
+// Number of consecutive replay frames handed to a worker thread at a time.
+static const int BLOCK_COLUMNS = 16;
+
+// Depth of the background stages reading the recordings.
+static const size_t LOAD_DEPTH = 16;
+
+// Initial buffer size for recordings, doubled as they are read.
+static const size_t LOAD_SIZE = 256;
+
+inline float teachIndex(const cv::Point3f &line, float index) {
+    return line.y + (index - line.x) * line.z;
+}
+
+/*
+Hands out task indices in [0, total) to worker threads, in increasing order.
+*/
+struct Schedule {
+    boost::mutex lock;
+
+    int next;
+
+    int total;
+};
+
+static void work(Schedule *schedule, boost::function<void(int)> task) {
+    for (;;) {
+        int k = 0;
+        {
+            boost::mutex::scoped_lock guard(schedule->lock);
+            k = schedule->next++;
+        }
+
+        if (k >= schedule->total) {
+            return;
+        }
+
+        task(k);
+    }
+}
+
+static void parallelFor(int total, int threads, boost::function<void(int)> task) {
+    Schedule schedule;
+    schedule.next = 0;
+    schedule.total = total;
+
+    boost::thread_group group;
+    for (int t = 0, n = std::min(threads, total); t < n; t++) {
+        group.create_thread(boost::bind(work, &schedule, task));
+    }
+
+    group.join_all();
+}
+
+BatchMatcher::BatchMatcher():
+    threads(0)
+{
+    // Nothing to do.
+}
+
+BatchMatcher::BatchMatcher(
+    SensorStream teachStream,
+    SensorStream replayStream,
+    Selector selector,
+    int padding_a,
+    int padding_b,
+    Comparator comparator,
+    int _threads
+):
+    teach(teachStream, LOAD_SIZE, padding_b, comparator),
+    replay(replayStream, LOAD_SIZE, selector, padding_a),
+    threads(_threads)
+{
+    // Nothing to do.
+}
+
+void BatchMatcher::load() {
+    if (teach.frames.size() > 0 || replay.frames.size() > 0) {
+        return;
+    }
+
+    teach.pipeline(LOAD_DEPTH);
+    replay.pipeline(LOAD_DEPTH);
+
+    for (;;) {
+        if (teach.frames.size() == teach.size) {
+            teach.resize(teach.size * 2);
+        }
+
+        if (!teach.read()) {
+            break;
+        }
+    }
+
+    for (;;) {
+        if (replay.frames.size() == replay.size) {
+            replay.resize(replay.size * 2);
+        }
+
+        if (!replay.read()) {
+            break;
+        }
+    }
+}
+
+void BatchMatcher::evaluate() {
+    load();
+    std::vector<cv::Range> bands(replay.maps.size(), cv::Range(0, teach.edges.size()));
+    evaluate(bands);
+}
+
+void BatchMatcher::evaluate(const std::vector<cv::Range> &bands) {
+    load();
+
+    int cols = replay.maps.size();
+    cells.assign(cols, cv::Mat());
+    ranges.assign(cols, cv::Range(0, 0));
+
+    int blocks = (cols + BLOCK_COLUMNS - 1) / BLOCK_COLUMNS;
+    parallelFor(blocks, workers(), boost::bind(&BatchMatcher::evaluateBlock, this, boost::cref(bands), _1));
+}
+
+void BatchMatcher::evaluateBlock(const std::vector<cv::Range> &bands, int block) {
+    const TeachWindow &window = teach.edges;
+    int rows = window.size();
+    int j0 = block * BLOCK_COLUMNS;
+    int j1 = std::min(j0 + BLOCK_COLUMNS, (int) replay.maps.size());
+
+    // Scratch matrices span each column's band only, starting at the band's first row.
+    std::vector<cv::Mat> scratch;
+    std::vector<cv::Mat> offsets;
+    std::vector<cv::Range> clipped;
+    int start = rows;
+    int end = 0;
+    for (int j = j0; j < j1; j++) {
+        const FeatureMap &map = replay.maps.at(j);
+        cv::Range band(std::max(bands[j].start, 0), std::min(bands[j].end, rows));
+        band.end = std::max(band.start, band.end);
+        clipped.push_back(band);
+        scratch.push_back(cv::Mat(band.size(), map.size(), map.similarityType(window)));
+        offsets.push_back(cv::Mat(band.size(), map.size(), CV_32S));
+        if (band.start < band.end) {
+            start = std::min(start, band.start);
+            end = std::max(end, band.end);
+        }
+    }
+
+    int height = cight::stripHeight(replay.maps, j0, j1, teach.padding);
+    int tile = cight::tileFrames(window, height);
+    for (int y = 0, h = window.frameSize().height; y < h; y += height) {
+        cv::Range strip(y, y + height);
+        for (int i0 = start; i0 < end; i0 += tile) {
+            int n = std::min(i0 + tile, end);
+            for (int j = j0; j < j1; j++) {
+                const cv::Range &band = clipped[j - j0];
+                int i = std::max(i0, band.start);
+                int m = std::min(n, band.end);
+                replay.maps.at(j).evaluate(window, teach.padding, i, m, scratch[j - j0], offsets[j - j0], 0, -1, strip, band.start);
+            }
+        }
+    }
+
+    for (int j = j0; j < j1; j++) {
+        const cv::Range &band = clipped[j - j0];
+        ranges[j] = band;
+        if (band.start < band.end) {
+            cells[j] = scratch[j - j0];
+        }
+    }
+}
+
+cv::Mat BatchMatcher::similarities() const {
+    int rows = teach.edges.size();
+    int cols = cells.size();
+    cv::Mat map(rows, cols, CV_32F, cv::Scalar(0));
+    for (int j = 0; j < cols; j++) {
+        const cv::Range &range = ranges[j];
+        if (range.start >= range.end) {
+            continue;
+        }
+
+        cv::Mat responses = replay.maps.at(j).tally(cells[j], 0, cells[j].rows);
+        cv::Mat column(map, cv::Rect(j, range.start, 1, range.end - range.start));
+        responses.copyTo(column);
+    }
+
+    return map;
+}
+
+cv::Mat BatchMatcher::similarities(int s, const cv::Size &window) const {
+    cv::Mat map(window, CV_32F, cv::Scalar(0));
+    for (int k = 0; k < window.width; k++) {
+        int j = s + k;
+        int i0 = s - ranges[j].start;
+        cv::Mat responses = replay.maps.at(j).tally(cells[j], i0, i0 + window.height);
+        cv::Mat column(map, cv::Rect(k, 0, 1, window.height));
+        cv::Mat(responses, cv::Rect(0, i0, 1, window.height)).copyTo(column);
+    }
+
+    return map;
+}
+
+void BatchMatcher::fitWindow(const Interpolator &interpolator, const cv::Size &window, std::vector<cv::Point3f> &lines, int s) const {
+    lines[s] = interpolator(similarities(s, window));
+}
+
+List<cv::Point> BatchMatcher::operator () (const cv::Size &window, const Interpolator &interpolator) {
+    load();
+
+    int rows = teach.edges.size();
+    int cols = replay.maps.size();
+    int steps = std::min(rows - window.height, cols - window.width) + 1;
+    if (steps <= 0) {
+        return List<cv::Point>();
+    }
+
+    // Each replay frame is only ever compared to teach frames in windows it belongs to.
+    std::vector<cv::Range> bands(cols, cv::Range(0, 0));
+    for (int j = 0; j < cols; j++) {
+        int s0 = std::max(0, j - window.width + 1);
+        int s1 = std::min(j, steps - 1);
+        if (s0 <= s1) {
+            bands[j] = cv::Range(s0, s1 + window.height);
+        }
+    }
+
+    evaluate(bands);
+
+    std::vector<cv::Point3f> lines(steps);
+    parallelFor(steps, workers(), boost::bind(&BatchMatcher::fitWindow, this, boost::cref(interpolator), window, boost::ref(lines), _1));
+
+    // Emit matches the way the online matcher does, correcting each line against the last.
+    int last = window.width - 1;
+    cv::Point3f line(0, 0, 0);
+    List<cv::Point> matches;
+    for (int s = 0; s < steps; s++) {
+        if (s > 0) {
+            line.x--;
+            line.y--;
+        }
+
+        cv::Point3f line2 = lines[s];
+        float y1 = teachIndex(line, last - 1);
+        float y2 = teachIndex(line2, last);
+        if (y1 > y2) {
+            line2.z = (y1 - line2.y) / (last - line2.x);
+        }
+
+        line = line2;
+
+        for (int index = (s == 0 ? (int) line.x : last); index <= last; index++) {
+            int matched = teachIndex(line, index);
+            matches.append(cv::Point(s + index, s + matched));
+        }
+    }
+
+    return matches;
+}
+
+int BatchMatcher::workers() const {
+    if (threads > 0) {
+        return threads;
+    }
+
+    return std::max((int) boost::thread::hardware_concurrency(), 1);
+}
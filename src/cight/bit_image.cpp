@@ -0,0 +1,185 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cight/bit_image.hpp>
+using cight::BitImage;
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+BitImage::BitImage():
+    width(0),
+    on(0)
+{
+    // Nothing to do.
+}
+
+BitImage::BitImage(const cv::Mat &mask):
+    words(mask.rows, 8 * ((mask.cols + 63) / 64), CV_8U, cv::Scalar(0)),
+    width(mask.cols),
+    on(0)
+{
+    if (mask.channels() != 1) {
+        throw std::runtime_error("Only single-channel masks can be packed");
+    }
+
+    cv::Mat bytes;
+    if (mask.depth() == CV_8U) {
+        bytes = mask;
+    }
+    else {
+        cv::compare(mask, 0, bytes, cv::CMP_NE);
+    }
+
+    cv::minMaxLoc(mask, NULL, &on);
+
+    for (int i = 0, m = mask.rows; i < m; i++) {
+        const uchar *pixels = bytes.ptr<uchar>(i);
+        boost::uint64_t *packed = (boost::uint64_t*) words.ptr(i);
+        for (int j = 0; j < width; j++) {
+            if (pixels[j] != 0) {
+                packed[j >> 6] |= ((boost::uint64_t) 1) << (j & 63);
+            }
+        }
+    }
+}
+
+int BitImage::rows() const {
+    return words.rows;
+}
+
+int BitImage::cols() const {
+    return width;
+}
+
+int BitImage::span() const {
+    return words.cols / 8;
+}
+
+double BitImage::level() const {
+    return on;
+}
+
+const boost::uint64_t *BitImage::row(int i) const {
+    return (const boost::uint64_t*) words.ptr(i);
+}
+
+cv::Mat BitImage::unpack(uchar value) const {
+    cv::Mat mask(words.rows, width, CV_8U, cv::Scalar(0));
+    for (int i = 0, m = words.rows; i < m; i++) {
+        const boost::uint64_t *packed = row(i);
+        uchar *pixels = mask.ptr<uchar>(i);
+        for (int j = 0; j < width; j++) {
+            if ((packed[j >> 6] >> (j & 63)) & 1) {
+                pixels[j] = value;
+            }
+        }
+    }
+
+    return mask;
+}
+
+static void checkSizes(const BitImage &u, const BitImage &v) {
+    if (u.rows() != v.rows() || u.cols() != v.cols()) {
+        throw std::runtime_error("Bit images must be of the same size");
+    }
+}
+
+void cight::accumulate_changes(const BitImage &u, const BitImage &v, cv::Mat &counts) {
+    checkSizes(u, v);
+    for (int i = 0, m = u.rows(), n = u.span(); i < m; i++) {
+        const boost::uint64_t *a = u.row(i);
+        const boost::uint64_t *b = v.row(i);
+        int *totals = counts.ptr<int>(i);
+        for (int k = 0; k < n; k++) {
+            boost::uint64_t changed = a[k] ^ b[k];
+            while (changed != 0) {
+                totals[64 * k + lowestBit(changed)]++;
+                changed &= changed - 1;
+            }
+        }
+    }
+}
+
+/*
+A run of bits from one word of a packed row, falling into a single column bin.
+*/
+struct Segment {
+    int word;
+
+    int bin;
+
+    boost::uint64_t mask;
+
+    Segment(int _word, int _bin, boost::uint64_t _mask):
+        word(_word),
+        bin(_bin),
+        mask(_mask)
+    {
+        // Nothing to do.
+    }
+};
+
+static std::vector<Segment> segments(int cols, size_t bins) {
+    std::vector<Segment> result;
+    int width = cols / bins;
+    if (width == 0) {
+        return result;
+    }
+
+    int end = width * bins;
+    for (int start = 0; start < end;) {
+        int word = start / 64;
+        int bin = start / width;
+        int stop = std::min(std::min(64 * (word + 1), width * (bin + 1)), end);
+
+        int lo = start - 64 * word;
+        int length = stop - start;
+        boost::uint64_t mask = (length == 64 ? ~((boost::uint64_t) 0) : ((((boost::uint64_t) 1) << length) - 1) << lo);
+
+        result.push_back(Segment(word, bin, mask));
+        start = stop;
+    }
+
+    return result;
+}
+
+static void accumulateBins(const BitImage &u, const BitImage *v, size_t bins, cv::Mat &totals) {
+    std::vector<Segment> runs = segments(u.cols(), bins);
+    int *sums = totals.ptr<int>(0);
+    for (int i = 0, m = u.rows(); i < m; i++) {
+        const boost::uint64_t *a = u.row(i);
+        const boost::uint64_t *b = (v != NULL ? v->row(i) : NULL);
+        for (int s = 0, n = runs.size(); s < n; s++) {
+            const Segment &run = runs[s];
+            boost::uint64_t bits = (b != NULL ? a[run.word] ^ b[run.word] : a[run.word]);
+            sums[run.bin] += cight::popcount(bits & run.mask);
+        }
+    }
+}
+
+void cight::accumulate_changes(const BitImage &u, const BitImage &v, size_t bins, cv::Mat &totals) {
+    checkSizes(u, v);
+    accumulateBins(u, &v, bins, totals);
+}
+
+void cight::accumulate_bins(const BitImage &u, size_t bins, cv::Mat &totals) {
+    accumulateBins(u, NULL, bins, totals);
+}
@@ -101,7 +101,9 @@ DifferenceMatcher::DifferenceMatcher(
     replay(_replay),
     similarities(teach.size, replay.size),
     line(0, 0, 0),
-    index(-1)
+    index(-1),
+    windowMin(replay.size, teach.size),
+    windowMax(replay.size, teach.size)
 {
     // Nothing to do.
 }
@@ -139,19 +141,23 @@ List<cv::Mat> DifferenceMatcher::operator () () {
     }
 
     if (index >= similarities.cols) {
+        adapt();
+
         teach.pop();
         line.y--;
 
         replay.pop();
         line.x--;
 
+        // Columns still to be filled by the update, usually just the last one.
+        int fresh = similarities.cols - replay.diffs.size();
         if (computeMatching() == false) {
             return List<cv::Mat>();
         }
 
-        recordResponses(similarities, INDEX_N, similarities.cols);
+        recordResponses(similarities, similarities.cols - fresh, similarities.cols);
 
-        index = INDEX_N;
+        index = similarities.cols - fresh;
     }
 
     int matched = teachIndex(line, index);
@@ -185,6 +191,7 @@ bool DifferenceMatcher::computeMatching() {
     }
 */
     line = line2;
+    similarities.fit(line);
     recordLines(line);
 
     index = line.x;
@@ -193,3 +200,20 @@ bool DifferenceMatcher::computeMatching() {
 
     return true;
 }
+
+void DifferenceMatcher::adapt() {
+    if (windowMin == windowMax) {
+        return;
+    }
+
+    cv::Size size = cight::adaptWindow(line, similarities.confidence, windowMin, windowMax);
+    int dy = std::max((int) teach.diffs.size() - size.height, 0);
+    int dx = std::max((int) replay.diffs.size() - size.width, 0);
+
+    teach.resize(size.height);
+    replay.resize(size.width);
+    similarities.resizeWindow(size);
+
+    line.x -= dx;
+    line.y -= dy;
+}
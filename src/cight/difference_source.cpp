@@ -0,0 +1,75 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cight/difference_source.hpp>
+using cight::DifferenceSource;
+
+#include <stdexcept>
+
+DifferenceSource::DifferenceSource() {
+    // Nothing to do.
+}
+
+DifferenceSource::DifferenceSource(const RouteFile &_route):
+    route(_route)
+{
+    if (route.size(cight::ROUTE_DIFFS) == 0) {
+        throw std::runtime_error("Route file lacks difference images");
+    }
+}
+
+DifferenceSource::DifferenceSource(SensorStream sensor, size_t size, double threshold):
+    stream(new DifferenceStream(sensor, size, threshold)),
+    produced(new int(0))
+{
+    // Nothing to do.
+}
+
+cv::Mat DifferenceSource::operator () (int k) {
+    if (k < 0) {
+        return cv::Mat();
+    }
+
+    if (!route.empty()) {
+        return route.frame(cight::ROUTE_DIFFS, k);
+    }
+
+    if (stream.get() == NULL) {
+        return cv::Mat();
+    }
+
+    while (*produced <= k) {
+        if (!stream->read()) {
+            return cv::Mat();
+        }
+
+        (*produced)++;
+    }
+
+    int first = *produced - (int) stream->diffs.size();
+    if (k < first) {
+        throw std::runtime_error("Difference image no longer buffered");
+    }
+
+    return stream->diffs.at(k - first);
+}
+
+bool DifferenceSource::empty() const {
+    return route.empty() && stream.get() == NULL;
+}
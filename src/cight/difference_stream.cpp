@@ -27,14 +27,25 @@ using cight::StreamBuffer;
 #include <clarus/vision/images.hpp>
 
 DifferenceStream::DifferenceStream():
-    StreamBuffer()
+    StreamBuffer(),
+    cursor(0)
 {
     threshold = 0;
 }
 
 DifferenceStream::DifferenceStream(SensorStream stream, size_t size, double _threshold):
     StreamBuffer(stream, size),
-    threshold(_threshold)
+    threshold(_threshold),
+    cursor(0)
+{
+    // Nothing to do.
+}
+
+DifferenceStream::DifferenceStream(const RouteFile &_route, size_t size):
+    StreamBuffer(SensorStream(), size),
+    threshold(_route.threshold()),
+    route(_route),
+    cursor(0)
 {
     // Nothing to do.
 }
@@ -50,6 +61,28 @@ void DifferenceStream::pop() {
 }
 
 bool DifferenceStream::read() {
+    if (!route.empty()) {
+        if (frames.empty() && route.size(cight::ROUTE_FRAMES) > 0) {
+            frames.append(route.at(cight::ROUTE_FRAMES, 0));
+            indices.append(route.index(0));
+        }
+
+        if (cursor >= route.size(cight::ROUTE_DIFFS)) {
+            return false;
+        }
+
+        frames.append(route.at(cight::ROUTE_FRAMES, cursor + 1));
+        indices.append(route.index(cursor + 1));
+        diffs.append(route.at(cight::ROUTE_DIFFS, cursor));
+        cursor++;
+
+        if (diffs.size() > size) {
+            pop();
+        }
+
+        return true;
+    }
+
     for (int i = 1;; i++) {
         cv::Mat frame = stream();
         if (frame.empty()) {
@@ -80,3 +113,10 @@ bool DifferenceStream::read() {
         return true;
     }
 }
+
+void DifferenceStream::resize(size_t _size) {
+    size = _size;
+    while (diffs.size() > size) {
+        pop();
+    }
+}
@@ -62,14 +62,14 @@ using clarus::List;
     #define displayMemory(A, B)
 #endif
 
-inline cv::Mat preprocess(const cv::Mat &image) {
+inline cv::Mat preprocess(const cight::Frame &frame) {
     //return colors::grayscale(cight::upper_half(image));
 /*
     cv::Mat grad;
     cv::Sobel(cight::upper_half(image), grad, CV_8U, 1, 0, CV_SCHARR);
     return grad;
 */
-    return cight::upper_half(image);
+    return frame.upper();
 }
 
 Estimator::Estimator(int _bins, int _window, size_t range, StreamMatcher _matcher):
@@ -104,18 +104,20 @@ cv::Mat Estimator::operator () () {
     }
     while (teach.idle() > 0);
 
+#ifdef DIAGNOSTICS
     cv::Mat teachMap = change_average(teach);
     cv::Mat replayMap = change_average(replay);
-
     displayDiVS(teachMap, replayMap);
+#endif
 
     List<cv::Mat> matched = matcher();
     if (matched.empty()) {
         return cv::Mat();
     }
 
-    cv::Mat teachVector = column_histogram(teachMap, bins);
-    cv::Mat replayVector = column_histogram(replayMap, bins);
+    // Same as column_histogram(change_average(...), bins), but counted on packed masks.
+    cv::Mat teachVector = change_histogram(teach, bins) / (double) (teach.size() - 1);
+    cv::Mat replayVector = change_histogram(replay, bins) / (double) (replay.size() - 1);
 
     int n = teachVector.cols;
     cv::Mat responses(1, n * 2, CV_64F, cv::Scalar::all(0));
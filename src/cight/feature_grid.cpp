@@ -0,0 +1,161 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cight/feature_grid.hpp>
+using cight::Candidate;
+using cight::CandidateGrid;
+using cight::ExclusionGrid;
+
+#include <algorithm>
+
+Candidate::Candidate(int _x, int _y, float _strength):
+    x(_x),
+    y(_y),
+    strength(_strength)
+{
+    // Nothing to do.
+}
+
+bool cight::strongerCandidate(const Candidate &a, const Candidate &b) {
+    if (a.strength != b.strength) {
+        return a.strength > b.strength;
+    }
+
+    return (a.y != b.y ? a.y < b.y : a.x < b.x);
+}
+
+CandidateGrid::CandidateGrid(const cv::Size &size, int _side, int _top):
+    side(std::max(_side, 1)),
+    cols((size.width + side - 1) / side),
+    top(std::max(_top, 1)),
+    cells(cols * ((size.height + side - 1) / side))
+{
+    // Nothing to do.
+}
+
+void CandidateGrid::insert(int x, int y, float strength) {
+    std::vector<Candidate> &bucket = cells[(y / side) * cols + x / side];
+    if (bucket.size() < top) {
+        bucket.push_back(Candidate(x, y, strength));
+        std::push_heap(bucket.begin(), bucket.end(), strongerCandidate);
+    }
+    else if (strength > bucket.front().strength) {
+        std::pop_heap(bucket.begin(), bucket.end(), strongerCandidate);
+        bucket.back() = Candidate(x, y, strength);
+        std::push_heap(bucket.begin(), bucket.end(), strongerCandidate);
+    }
+}
+
+std::vector<Candidate> CandidateGrid::select(int budget) const {
+    std::vector<Candidate> kept;
+    for (size_t k = 0, n = cells.size(); k < n; k++) {
+        const std::vector<Candidate> &bucket = cells[k];
+        kept.insert(kept.end(), bucket.begin(), bucket.end());
+    }
+
+    if (budget > 0 && kept.size() > (size_t) budget) {
+        std::nth_element(kept.begin(), kept.begin() + budget, kept.end(), strongerCandidate);
+        kept.erase(kept.begin() + budget, kept.end());
+    }
+
+    std::sort(kept.begin(), kept.end(), strongerCandidate);
+
+    return kept;
+}
+
+ExclusionGrid::ExclusionGrid():
+    size(0, 0),
+    padding(0),
+    side(1),
+    cols(1),
+    rows(1),
+    cells(1)
+{
+    // Nothing to do.
+}
+
+ExclusionGrid::ExclusionGrid(const cv::Size &_size, int _padding):
+    size(_size),
+    padding(_padding),
+    side(4 * _padding + 1),
+    cols(std::max((size.width + side - 1) / side, 1)),
+    rows(std::max((size.height + side - 1) / side, 1)),
+    cells(cols * rows)
+{
+    // Nothing to do.
+}
+
+void ExclusionGrid::reset(const cv::Size &_size, int _padding) {
+    size = _size;
+    padding = _padding;
+    side = 4 * padding + 1;
+    cols = std::max((size.width + side - 1) / side, 1);
+    rows = std::max((size.height + side - 1) / side, 1);
+
+    size_t n = cols * rows;
+    if (cells.size() < n) {
+        cells.resize(n);
+    }
+
+    for (size_t k = 0; k < n; k++) {
+        cells[k].clear();
+    }
+}
+
+int ExclusionGrid::cellX(int x) const {
+    return std::min(std::max(x / side, 0), cols - 1);
+}
+
+int ExclusionGrid::cellY(int y) const {
+    return std::min(std::max(y / side, 0), rows - 1);
+}
+
+bool ExclusionGrid::claim(const cv::Point &center) {
+    int x = center.x;
+    int y = center.y;
+
+    // Centers too close to the image borders are moved inwards by the padding.
+    int i = y + std::max(padding - y, 0) + std::min(size.height - y - padding, 0);
+    int j = x + std::max(padding - x, 0) + std::min(size.width - x - padding, 0);
+
+    cv::Point point(j, i);
+    const std::vector<cv::Rect> &squares = cells[cellY(i) * cols + cellX(j)];
+    for (size_t k = 0, n = squares.size(); k < n; k++) {
+        if (squares[k].contains(point)) {
+            return false;
+        }
+    }
+
+    int padding2 = 2 * padding;
+    int x2 = std::min(std::max(j - padding2, 0), size.width - side);
+    int y2 = std::min(std::max(i - padding2, 0), size.height - side);
+    cv::Rect square(x2, y2, side, side);
+
+    int i0 = cellY(square.y);
+    int in = cellY(square.y + square.height - 1);
+    int j0 = cellX(square.x);
+    int jn = cellX(square.x + square.width - 1);
+    for (int a = i0; a <= in; a++) {
+        for (int b = j0; b <= jn; b++) {
+            cells[a * cols + b].push_back(square);
+        }
+    }
+
+    return true;
+}
@@ -20,10 +20,17 @@ along with Cight. If not, see <http://www.gnu.org/licenses/>.
 #include <cight/feature_map.hpp>
 using clarus::List;
 using cight::FeatureMap;
+using cight::Frame;
+using cight::TeachWindow;
+
+#include <cight/transforms.hpp>
 
 #include <clarus/core/math.hpp>
 
+#include <algorithm>
 #include <map>
+#include <utility>
+#include <stdexcept>
 
 #ifdef DIAGNOSTICS
     #include <clarus/core/types.hpp>
@@ -33,12 +40,12 @@ using cight::FeatureMap;
     #include <clarus/vision/images.hpp>
     #include <iostream>
 
-    static void display(const cv::Mat &bgr, const List<cight::FeaturePoint> &regions) {
+    static void display(const cight::Frame &frame, const List<cight::FeaturePoint> &regions) {
         static cv::Scalar RED(0, 0, 255);
 
         static int index = 0;
 
-        cv::Mat canvas = colors::convert(filter::sobel(colors::grayscale(bgr)), CV_GRAY2BGR);
+        cv::Mat canvas = colors::convert(frame.sobel(), CV_GRAY2BGR);
         for (int i = 0, n = regions.size(); i < n; i++) {
             cv::rectangle(canvas, regions[i].bounds, RED);
         }
@@ -51,16 +58,79 @@ using cight::FeatureMap;
     #define display(A, B)
 #endif
 
-FeatureMap::FeatureMap(Selector selector, const cv::Mat &bgr, int padding):
-    features(selector(bgr, padding))
+FeatureMap::FeatureMap():
+    side(0)
+{
+    // Nothing to do.
+}
+
+FeatureMap::FeatureMap(Selector selector, const Frame &frame, int padding):
+    features(selector(frame, padding)),
+    side(0)
 {
-    display(bgr, features);
+    display(frame, features);
+    pack();
 }
 
 FeatureMap::FeatureMap(const List<FeaturePoint> &_features):
-    features(_features)
+    features(_features),
+    side(0)
 {
-    // Nothing to do.
+    pack();
+}
+
+FeatureMap FeatureMap::reduced(const Frame &frame, int n) const {
+    cv::Mat image = frame.level(n).sobel();
+    int padding = std::max((side / 2) >> n, 1);
+
+    List<FeaturePoint> points;
+    for (int j = 0, m = features.size(); j < m; j++) {
+        const FeaturePoint &point = features[j];
+        points.append(FeaturePoint(point.center.x >> n, point.center.y >> n, point.strength, image, padding));
+    }
+
+    return FeatureMap(points);
+}
+
+void FeatureMap::pack() {
+    int n = features.size();
+    if (n == 0) {
+        return;
+    }
+
+    const cv::Mat &first = features[0].patch;
+    side = first.rows;
+
+    // Pad rows to a multiple of 16 bytes (where the element size allows it), so
+    // every patch row starts aligned.
+    size_t bytes = cv::alignSize(side * first.elemSize(), 16);
+    int stride = bytes / first.elemSize();
+    if (stride * first.elemSize() != bytes) {
+        stride = side;
+    }
+
+    arena = cv::Mat(n * side, stride, first.type(), cv::Scalar::all(0));
+    codes = cv::Mat();
+    bounds.resize(n);
+    strengths.resize(n);
+    means.resize(n);
+    norms.resize(n);
+
+    for (int j = 0; j < n; j++) {
+        FeaturePoint &point = features[j];
+        if (point.patch.rows != side || point.patch.cols != side || point.patch.type() != first.type()) {
+            throw std::runtime_error("Feature points in a map must have patches of the same size and type");
+        }
+
+        cv::Mat packed(arena, cv::Rect(0, j * side, side, side));
+        point.patch.copyTo(packed);
+        point.patch = packed;
+
+        bounds[j] = point.bounds;
+        strengths[j] = point.strength;
+        means[j] = cv::mean(packed)[0];
+        norms[j] = cv::norm(packed, cv::NORM_L2);
+    }
 }
 
 inline void update_shifts(cv::Mat &shifts, int i, int rows, cv::Mat &responses) {
@@ -152,6 +222,461 @@ List<cv::Mat> FeatureMap::operator () (const List<cv::Mat> &images, int padding,
     return (List<cv::Mat>(), responses, similarities);
 }
 
+List<cv::Mat> FeatureMap::operator () (
+    const TeachWindow &window,
+    int padding,
+    int i0,
+    int n,
+    bool exact,
+    int shift,
+    int radius
+) const {
+    int rows = window.size();
+    int cols = features.size();
+    if (n == 0) {
+        n = rows;
+    }
+
+    cv::Mat similarities(rows, cols, similarityType(window), cv::Scalar(0));
+    cv::Mat responses;
+    cv::Mat shifts;
+    if (exact || window.comparator() != DIRECT) {
+        cv::Mat offsets(rows, cols, CV_32S, cv::Scalar(0));
+        evaluate(window, padding, i0, n, similarities, offsets, shift, radius);
+        responses = tally(similarities, i0, n);
+        shifts = displacements(similarities, offsets, i0, n);
+    }
+    else {
+        cv::Mat offsets(rows, cols, CV_32S, cv::Scalar(0));
+        cv::Mat evaluated(rows, cols, CV_8U, cv::Scalar(0));
+        responses = cv::Mat(rows, 1, CV_32F, cv::Scalar(0));
+        shifts = cv::Mat(1, cols, CV_32S, cv::Scalar(0));
+        prune(window, padding, i0, n, similarities, offsets, evaluated, responses, shifts, shift, radius);
+    }
+
+    return (List<cv::Mat>(), responses, similarities, shifts);
+}
+
+void FeatureMap::evaluate(
+    const TeachWindow &window,
+    int padding,
+    int i0,
+    int n,
+    cv::Mat &similarities,
+    cv::Mat &offsets,
+    int shift,
+    int radius,
+    const cv::Range &strip,
+    int first
+) const {
+    if (n <= i0) {
+        return;
+    }
+
+    cv::Size size = window.frameSize();
+    for (int j = 0, m = features.size(); j < m; j++) {
+        const FeaturePoint &point = features[j];
+        cv::Rect area = point.neighborhood(size, padding, shift, radius);
+        int top = std::max(area.y, 0);
+        if (top < strip.start || strip.end <= top) {
+            continue;
+        }
+        if (window.comparator() == CENSUS) {
+            cight::matchCensus(patchCensus(j), window, area, i0, n, similarities, j, &offsets, first);
+        }
+        else if (window.comparator() == DIRECT) {
+            cight::correlateWindow(point.patch, window, area, i0, n, similarities, j, &offsets, first);
+        }
+        else {
+            cight::correlateFourier(point.patch, window, area, i0, n, similarities, j, &offsets, first);
+        }
+    }
+}
+
+int FeatureMap::similarityType(const TeachWindow &window) const {
+    bool integer = (window.comparator() == DIRECT && window.type() == CV_8U && arena.type() == CV_8U);
+    return (integer ? CV_32S : CV_32F);
+}
+
+// Reads a similarity value from either an integer or a floating-point similarity map.
+static inline double similarityAt(const cv::Mat &similarities, int i, int j) {
+    if (similarities.type() == CV_32S) {
+        return similarities.at<int>(i, j);
+    }
+
+    return similarities.at<float>(i, j);
+}
+
+int FeatureMap::bestFrame(const cv::Mat &similarities, int j, int i0, int n) const {
+    int index = i0;
+    double best = similarityAt(similarities, i0, j);
+    for (int i = i0 + 1; i < n; i++) {
+        double value = similarityAt(similarities, i, j);
+        if (best < value) {
+            best = value;
+            index = i;
+        }
+    }
+
+    return index;
+}
+
+cv::Mat FeatureMap::tally(const cv::Mat &similarities, int i0, int n) const {
+    cv::Mat responses(similarities.rows, 1, CV_32F, cv::Scalar(0));
+    if (n <= i0) {
+        return responses;
+    }
+
+    for (int j = 0, m = features.size(); j < m; j++) {
+        int index = bestFrame(similarities, j, i0, n);
+        responses.at<float>(index, 0) += 1.0f;
+    }
+
+    return responses;
+}
+
+cv::Mat FeatureMap::displacements(const cv::Mat &similarities, const cv::Mat &offsets, int i0, int n) const {
+    int cols = features.size();
+    cv::Mat shifts(1, cols, CV_32S, cv::Scalar(0));
+    if (n <= i0) {
+        return shifts;
+    }
+
+    for (int j = 0; j < cols; j++) {
+        int index = bestFrame(similarities, j, i0, n);
+        shifts.at<int>(0, j) = offsets.at<int>(index, j) - bounds[j].x;
+    }
+
+    return shifts;
+}
+
+// Relative slack on correlation bounds, covering rounding differences between the
+// bound and the single-precision correlation kernel.
+static const float BOUND_SLACK = 1e-5f;
+
+static bool higherBound(const std::pair<float, int> &a, const std::pair<float, int> &b) {
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+void FeatureMap::prune(
+    const TeachWindow &window,
+    int padding,
+    int i0,
+    int n,
+    cv::Mat &similarities,
+    cv::Mat &offsets,
+    cv::Mat &evaluated,
+    cv::Mat &responses,
+    cv::Mat &displacements,
+    int shift,
+    int radius
+) const {
+    if (window.comparator() != DIRECT) {
+        throw std::runtime_error("Pruning requires a teach window using the DIRECT comparator");
+    }
+
+    if (n <= i0) {
+        return;
+    }
+
+    cv::Size size = window.frameSize();
+    cv::Size patch(side, side);
+    std::vector<std::pair<float, int> > order;
+    for (int j = 0, m = features.size(); j < m; j++) {
+        const FeaturePoint &point = features[j];
+        cv::Rect area = point.neighborhood(size, padding, shift, radius);
+
+        // Start from the best of the cells already evaluated, and bound the others.
+        int best = -1;
+        double top = 0.0;
+        order.clear();
+        for (int i = i0; i < n; i++) {
+            if (evaluated.at<uchar>(i, j) == 0) {
+                order.push_back(std::make_pair(cight::correlationBound(norms[j], patch, window, area, i), i));
+                continue;
+            }
+
+            double value = similarityAt(similarities, i, j);
+            if (best < 0 || top < value) {
+                best = i;
+                top = value;
+            }
+        }
+
+        std::sort(order.begin(), order.end(), higherBound);
+
+        for (int k = 0, o = order.size(); k < o; k++) {
+            double bound = order[k].first;
+            int i = order[k].second;
+            if (best >= 0 && bound * (1.0 + BOUND_SLACK) < top) {
+                break;
+            }
+
+            cight::correlateWindow(point.patch, window, area, i, i + 1, similarities, j, &offsets);
+            evaluated.at<uchar>(i, j) = 1;
+
+            double value = similarityAt(similarities, i, j);
+            if (best < 0 || top < value || (top == value && i < best)) {
+                best = i;
+                top = value;
+            }
+        }
+
+        responses.at<float>(best, 0) += 1.0f;
+        displacements.at<int>(0, j) = offsets.at<int>(best, j) - bounds[j].x;
+    }
+}
+
+int cight::stripHeight(const List<FeatureMap> &maps, int j0, int j1, int padding) {
+    int side = 1;
+    for (int j = j0; j < j1; j++) {
+        side = std::max(side, maps.at(j).patchSide());
+    }
+
+    return side + 2 * padding;
+}
+
+int cight::tileFrames(const TeachWindow &window, int height) {
+    size_t bytes = window.step() * std::min(2 * height, window.frameSize().height);
+    return std::max(1, (int) (TILE_CACHE_BYTES / std::max(bytes, (size_t) 1)));
+}
+
+List<List<cv::Mat> > cight::evaluateBatch(
+    const List<FeatureMap> &maps,
+    int j0,
+    int j1,
+    const TeachWindow &window,
+    int padding,
+    bool exact,
+    int shift,
+    int radius
+) {
+    if (!exact && window.comparator() == DIRECT) {
+        List<List<cv::Mat> > results;
+        for (int j = j0; j < j1; j++) {
+            results.append(maps.at(j)(window, padding, 0, 0, false, shift, radius));
+        }
+
+        return results;
+    }
+
+    int rows = window.size();
+    int height = cight::stripHeight(maps, j0, j1, padding);
+    int tile = cight::tileFrames(window, height);
+
+    std::vector<cv::Mat> similarities;
+    std::vector<cv::Mat> offsets;
+    for (int j = j0; j < j1; j++) {
+        const FeatureMap &map = maps.at(j);
+        similarities.push_back(cv::Mat(rows, map.size(), map.similarityType(window), cv::Scalar(0)));
+        offsets.push_back(cv::Mat(rows, map.size(), CV_32S, cv::Scalar(0)));
+    }
+
+    for (int y = 0, h = window.frameSize().height; y < h; y += height) {
+        cv::Range strip(y, y + height);
+        for (int i0 = 0; i0 < rows; i0 += tile) {
+            int n = std::min(i0 + tile, rows);
+            for (int j = j0; j < j1; j++) {
+                maps.at(j).evaluate(window, padding, i0, n, similarities[j - j0], offsets[j - j0], shift, radius, strip);
+            }
+        }
+    }
+
+    List<List<cv::Mat> > results;
+    for (int j = j0; j < j1; j++) {
+        const FeatureMap &map = maps.at(j);
+        const cv::Mat &matrix = similarities[j - j0];
+        cv::Mat responses = map.tally(matrix, 0, rows);
+        cv::Mat shifts = map.displacements(matrix, offsets[j - j0], 0, rows);
+        results.append((List<cv::Mat>(), responses, matrix, shifts));
+    }
+
+    return results;
+}
+
+// Returns a copy of the given matrix moved up by the given number of rows, zero-filling the bottom.
+static cv::Mat slide(const cv::Mat &matrix, int rows) {
+    cv::Mat moved(matrix.rows, matrix.cols, matrix.type(), cv::Scalar(0));
+    if (rows < matrix.rows) {
+        cv::Mat(matrix, cv::Rect(0, rows, matrix.cols, matrix.rows - rows)).copyTo(cv::Mat(moved, cv::Rect(0, 0, matrix.cols, matrix.rows - rows)));
+    }
+
+    return moved;
+}
+
+// Returns whether every feature point of a map was evaluated against teach frame i.
+static bool complete(const cv::Mat &evaluated, int i) {
+    return evaluated.cols == 0 || cv::countNonZero(evaluated.row(i)) == evaluated.cols;
+}
+
+List<List<cv::Mat> > cight::evaluateIncremental(
+    const List<FeatureMap> &maps,
+    const TeachWindow &window,
+    int padding,
+    int slid,
+    List<cv::Mat> &similarities,
+    List<cv::Mat> &offsets,
+    List<cv::Mat> &evaluated,
+    List<cv::Point> &searches,
+    const std::vector<cv::Range> &bands,
+    bool exact,
+    int shift,
+    int radius
+) {
+    int rows = window.size();
+    int cols = maps.size();
+    bool pruned = (!exact && window.comparator() == DIRECT);
+
+    // Ranges each map is tallied over, and the runs of rows in them with cells still
+    // to be evaluated.
+    std::vector<cv::Range> tallied(cols);
+    std::vector<std::vector<cv::Range> > missing(cols);
+    for (int j = 0; j < cols; j++) {
+        const FeatureMap &map = maps.at(j);
+        int type = map.similarityType(window);
+
+        bool reusable = false;
+        if (j < (int) similarities.size()) {
+            const cv::Mat &cached = similarities[j];
+            reusable = (cached.rows == rows && (size_t) cached.cols == map.size() && cached.type() == type && slid < rows);
+        }
+        else {
+            similarities.append(cv::Mat());
+            offsets.append(cv::Mat());
+            evaluated.append(cv::Mat());
+            searches.append(cv::Point(shift, radius));
+        }
+
+        if (reusable) {
+            similarities[j] = slide(similarities[j], slid);
+            offsets[j] = slide(offsets[j], slid);
+            evaluated[j] = slide(evaluated[j], slid);
+        }
+        else {
+            similarities[j] = cv::Mat(rows, map.size(), type, cv::Scalar(0));
+            offsets[j] = cv::Mat(rows, map.size(), CV_32S, cv::Scalar(0));
+            evaluated[j] = cv::Mat(rows, map.size(), CV_8U, cv::Scalar(0));
+            searches[j] = cv::Point(shift, radius);
+        }
+
+        cv::Range band(0, rows);
+        if (!bands.empty()) {
+            band = cv::Range(std::max(0, bands[j].start), std::min(rows, bands[j].end));
+            band.end = std::max(band.start, band.end);
+        }
+
+        tallied[j] = band;
+        if (pruned) {
+            continue;
+        }
+
+        const cv::Mat &done = evaluated[j];
+        for (int i = band.start; i < band.end;) {
+            if (complete(done, i)) {
+                i++;
+                continue;
+            }
+
+            int end = i + 1;
+            while (end < band.end && !complete(done, end)) {
+                end++;
+            }
+
+            missing[j].push_back(cv::Range(i, end));
+            i = end;
+        }
+    }
+
+    List<List<cv::Mat> > results;
+    if (pruned) {
+        for (int j = 0; j < cols; j++) {
+            const FeatureMap &map = maps.at(j);
+            const cv::Range &band = tallied[j];
+            const cv::Point &search = searches[j];
+            cv::Mat responses(rows, 1, CV_32F, cv::Scalar(0));
+            cv::Mat shifts(1, map.size(), CV_32S, cv::Scalar(0));
+            map.prune(window, padding, band.start, band.end, similarities[j], offsets[j], evaluated[j], responses, shifts, search.x, search.y);
+            results.append((List<cv::Mat>(), responses, similarities[j], shifts));
+        }
+
+        return results;
+    }
+
+    int height = cight::stripHeight(maps, 0, cols, padding);
+    int tile = cight::tileFrames(window, height);
+    for (int y = 0, h = window.frameSize().height; y < h; y += height) {
+        cv::Range strip(y, y + height);
+        for (int i0 = 0; i0 < rows; i0 += tile) {
+            int n = std::min(i0 + tile, rows);
+            for (int j = 0; j < cols; j++) {
+                const FeatureMap &map = maps.at(j);
+                const cv::Point &search = searches[j];
+                const std::vector<cv::Range> &runs = missing[j];
+                for (int k = 0, o = runs.size(); k < o; k++) {
+                    int i = std::max(i0, runs[k].start);
+                    int m = std::min(n, runs[k].end);
+                    map.evaluate(window, padding, i, m, similarities[j], offsets[j], search.x, search.y, strip);
+                }
+            }
+        }
+    }
+
+    for (int j = 0; j < cols; j++) {
+        const FeatureMap &map = maps.at(j);
+        const std::vector<cv::Range> &runs = missing[j];
+        for (int k = 0, o = runs.size(); k < o; k++) {
+            evaluated[j].rowRange(runs[k].start, runs[k].end).setTo(cv::Scalar(1));
+        }
+
+        const cv::Mat &matrix = similarities[j];
+        const cv::Range &band = tallied[j];
+        cv::Mat responses = map.tally(matrix, band.start, band.end);
+        cv::Mat shifts = map.displacements(matrix, offsets[j], band.start, band.end);
+        results.append((List<cv::Mat>(), responses, matrix, shifts));
+    }
+
+    return results;
+}
+
 size_t FeatureMap::size() const {
     return features.size();
 }
+
+int FeatureMap::patchSide() const {
+    return side;
+}
+
+cv::Mat FeatureMap::patch(int j) const {
+    return features[j].patch;
+}
+
+cv::Mat FeatureMap::patchCensus(int j) const {
+    if (codes.empty()) {
+        int n = features.size();
+        codes = cv::Mat(n * side, cv::alignSize(side, 16), CV_8U, cv::Scalar::all(0));
+        for (int k = 0; k < n; k++) {
+            // Patches are views into the arena: code a copy, so borders are replicated
+            // rather than taken from neighboring patches or row padding.
+            cv::Mat coded(codes, cv::Rect(0, k * side, side, side));
+            cight::census(features[k].patch.clone()).copyTo(coded);
+        }
+    }
+
+    return cv::Mat(codes, cv::Rect(0, j * side, side, side));
+}
+
+const cv::Rect &FeatureMap::patchBounds(int j) const {
+    return bounds[j];
+}
+
+float FeatureMap::strength(int j) const {
+    return strengths[j];
+}
+
+float FeatureMap::patchMean(int j) const {
+    return means[j];
+}
+
+float FeatureMap::patchNorm(int j) const {
+    return norms[j];
+}
@@ -0,0 +1,60 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cight/feature_pipeline.hpp>
+using cight::Candidate;
+using cight::Frame;
+using cight::SourceFAST;
+using cight::SourceGoodFeatures;
+
+// Candidates are left in detection order; the pipeline ranks them as it streams them.
+static void toCandidates(const std::vector<cv::KeyPoint> &keypoints, std::vector<Candidate> &candidates) {
+    for (size_t k = 0, n = keypoints.size(); k < n; k++) {
+        const cv::KeyPoint &point = keypoints[k];
+        candidates.push_back(Candidate(point.pt.x, point.pt.y, point.response));
+    }
+}
+
+SourceFAST::SourceFAST(const cv::FastFeatureDetector &_detector):
+    detector(_detector)
+{
+    // Nothing to do.
+}
+
+cv::Mat SourceFAST::operator () (const Frame &frame, std::vector<Candidate> &candidates) {
+    const cv::Mat &edges = frame.sobel();
+    keypoints.clear();
+    detector.detect(edges, keypoints);
+    toCandidates(keypoints, candidates);
+    return edges;
+}
+
+SourceGoodFeatures::SourceGoodFeatures(const cv::GoodFeaturesToTrackDetector &_detector):
+    detector(_detector)
+{
+    // Nothing to do.
+}
+
+cv::Mat SourceGoodFeatures::operator () (const Frame &frame, std::vector<Candidate> &candidates) {
+    const cv::Mat &edges = frame.sobel();
+    keypoints.clear();
+    detector.detect(edges, keypoints);
+    toCandidates(keypoints, candidates);
+    return edges;
+}
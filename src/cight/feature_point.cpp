@@ -30,13 +30,17 @@ FeaturePoint::FeaturePoint():
     // Nothing to do.
 }
 
-inline cv::Rect regionOfInterest(int x, int y, const cv::Mat &image, int padding) {
+cv::Rect FeaturePoint::boundsAt(int x, int y, const cv::Size &size, int padding) {
     int side = 2 * padding + 1;
-    int xf = std::min(std::max(0, x - padding), image.cols - side);
-    int yf = std::min(std::max(0, y - padding), image.rows - side);
+    int xf = std::min(std::max(0, x - padding), size.width - side);
+    int yf = std::min(std::max(0, y - padding), size.height - side);
     return cv::Rect(xf, yf, side, side);
 }
 
+inline cv::Rect regionOfInterest(int x, int y, const cv::Mat &image, int padding) {
+    return FeaturePoint::boundsAt(x, y, image.size(), padding);
+}
+
 inline float standardDeviation(const cv::Mat &patch) {
     cv::Mat mean, stddev;
     cv::meanStdDev(patch, mean, stddev);
@@ -61,12 +65,28 @@ FeaturePoint::FeaturePoint(const cv::KeyPoint &point, const cv::Mat &image, int
     // Nothing to do.
 }
 
-cv::Mat FeaturePoint::operator () (const cv::Mat &image, int padding) const {
-    int w = bounds.width + 2 * padding;
+FeaturePoint::FeaturePoint(int x, int y, float _strength, const cv::Mat &image, int padding):
+    bounds(regionOfInterest(x, y, image, padding)),
+    center(bounds.x + bounds.width / 2, bounds.y + bounds.height / 2),
+    patch(image, bounds),
+    strength(_strength)
+{
+    // Nothing to do.
+}
+
+cv::Rect FeaturePoint::neighborhood(const cv::Size &size, int padding, int shift, int radius) const {
+    if (radius < 0) {
+        radius = padding;
+    }
+
+    int w = std::min(bounds.width + 2 * radius, size.width);
     int h = bounds.height + 2 * padding;
-    int x = std::min(std::max(0, bounds.x - padding), image.cols - w);
-    int y = std::min(std::max(0, bounds.y - padding), image.rows - h);
+    int x = std::min(std::max(0, bounds.x + shift - radius), size.width - w);
+    int y = std::min(std::max(0, bounds.y - padding), size.height - h);
+    return cv::Rect(x, y, w, h);
+}
 
-    cv::Mat neighborhood(image, cv::Rect(x, y, w, h));
-    return fourier::correlate(neighborhood, patch);
+cv::Mat FeaturePoint::operator () (const cv::Mat &image, int padding) const {
+    cv::Mat area(image, neighborhood(image.size(), padding));
+    return fourier::correlate(area, patch);
 }
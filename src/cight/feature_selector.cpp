@@ -19,8 +19,20 @@ along with Cight. If not, see <http://www.gnu.org/licenses/>.
 
 #include <cight/feature_selector.hpp>
 using cight::FeaturePoint;
+using cight::Frame;
+using cight::Selector;
 using clarus::List;
 
+#include <cight/feature_grid.hpp>
+using cight::Candidate;
+using cight::CandidateGrid;
+using cight::ExclusionGrid;
+
+#include <cight/feature_pipeline.hpp>
+using cight::SelectorPipeline;
+using cight::SourceFAST;
+using cight::SourceGoodFeatures;
+
 #include <clarus/model/point.hpp>
 using clarus::Point;
 
@@ -28,16 +40,23 @@ using clarus::Point;
 #include <clarus/vision/filters.hpp>
 #include <clarus/vision/images.hpp>
 
-List<FeaturePoint> cight::selectAtMost(Selector selector, int limit, const cv::Mat &bgr, int padding) {
-    List<FeaturePoint> regions = selector(bgr, padding);
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <utility>
+#include <vector>
+
+List<FeaturePoint> cight::selectAtMost(Selector selector, int limit, const Frame &frame, int padding) {
+    List<FeaturePoint> regions = selector(frame, padding);
     return (regions.size() > limit ? regions(0, limit) : regions);
 }
 
-List<FeaturePoint> cight::selectBorders(Selector selector, float ratio, const cv::Mat &bgr, int padding) {
-    int xc = bgr.cols / 2;
-    int yc = bgr.rows / 2;
+List<FeaturePoint> cight::selectBorders(Selector selector, float ratio, const Frame &frame, int padding) {
+    cv::Size size = frame.size();
+    int xc = size.width / 2;
+    int yc = size.height / 2;
 
-    List<FeaturePoint> selected = selector(bgr, padding);
+    List<FeaturePoint> selected = selector(frame, padding);
     std::map<uint64_t, const FeaturePoint*> ordered;
     for (int k = 0, n = selected.size(); k < n; k++) {
         const FeaturePoint &region = selected[k];
@@ -59,88 +78,151 @@ List<FeaturePoint> cight::selectBorders(Selector selector, float ratio, const cv
     return regions;
 }
 
-static bool sortFeaturePoints(const FeaturePoint &a, const FeaturePoint &b) {
-    return a.strength > b.strength;
-}
+/*
+Heap comparator placing the strongest feature point at the front of the heap. Ties
+are broken by list position, so the pop order matches a stable sort by strength.
+*/
+struct WeakerFeature {
+    const std::vector<float> *strengths;
 
-List<FeaturePoint> cight::selectDisjoint(Selector selector, const cv::Mat &image, int padding) {
-    static cv::Scalar BLACK(0);
-    static cv::Scalar WHITE(1);
+    WeakerFeature(const std::vector<float> &_strengths):
+        strengths(&_strengths)
+    {
+        // Nothing to do.
+    }
 
-    List<FeaturePoint> selected = selector(image, padding);
-    clarus::sort(selected, sortFeaturePoints);
+    bool operator () (int a, int b) const {
+        float sa = (*strengths)[a];
+        float sb = (*strengths)[b];
+        return (sa != sb ? sa < sb : a > b);
+    }
+};
 
-    List<FeaturePoint> disjoint;
-    cv::Mat active(image.size(), CV_8U, BLACK);
-    int rows = image.rows;
-    int cols = image.cols;
+/*
+Returns the position of the strongest response within the given radius of the given
+point. Ties are resolved in favor of the original position, then of raster order.
+*/
+static cv::Point strongestNear(const cv::Mat &edges, const cv::Point &point, int radius) {
+    cv::Rect bounds(point.x - radius, point.y - radius, 2 * radius + 1, 2 * radius + 1);
+    bounds &= cv::Rect(0, 0, edges.cols, edges.rows);
+    if (bounds.area() == 0) {
+        return point;
+    }
 
-    int side = 2 * padding + 1;
-    int padding2 = 2 * padding;
-    int side2 = 2 * padding2 + 1;
+    cv::Point best = point;
+    double value = 0.0;
+    if (bounds.contains(point)) {
+        cv::Mat center(edges, cv::Rect(point.x, point.y, 1, 1));
+        cv::minMaxLoc(center, NULL, &value);
+    }
 
-    for (int k = 0, n = selected.size(); k < n; k++) {
-        const FeaturePoint &feature = selected[k];
-        const cv::Point &point = feature.center;
-        int x = point.x;
-        int y = point.y;
-
-        int i = y + std::max(padding - y, 0) + std::min(rows - y - padding, 0);
-        int j = x + std::max(padding - x, 0) + std::min(cols - x - padding, 0);
-        if (active.at<uint8_t>(i, j) == 1) {
+    double maxVal = 0.0;
+    cv::Point maxLoc;
+    cv::minMaxLoc(cv::Mat(edges, bounds), NULL, &maxVal, NULL, &maxLoc);
+    if (maxVal > value) {
+        best = cv::Point(bounds.x + maxLoc.x, bounds.y + maxLoc.y);
+    }
+
+    return best;
+}
+
+List<FeaturePoint> cight::selectPyramid(Selector selector, int level, int refine, const Frame &frame, int padding) {
+    if (level <= 0) {
+        return selector(frame, padding);
+    }
+
+    int scale = 1 << level;
+    int offset = scale / 2;
+    List<FeaturePoint> coarse = selector(frame.level(level), std::max(padding / scale, 1));
+
+    const cv::Mat &edges = frame.sobel();
+    std::set<std::pair<int, int> > unique;
+    List<FeaturePoint> regions;
+    for (int k = 0, n = coarse.size(); k < n; k++) {
+        const FeaturePoint &feature = coarse[k];
+        const cv::Point &center = feature.center;
+        cv::Point point(center.x * scale + offset, center.y * scale + offset);
+        if (refine > 0) {
+            point = strongestNear(edges, point, refine);
+        }
+
+        std::pair<int, int> key(point.x, point.y);
+        if (unique.count(key) > 0) {
             continue;
         }
 
-        disjoint.append(feature);
+        regions.append(FeaturePoint(point.x, point.y, feature.strength, edges, padding));
+        unique.insert(key);
+    }
+
+    return regions;
+}
+
+static List<FeaturePoint> disjointSubset(const List<FeaturePoint> &selected, int limit, const cv::Size &size, int padding) {
+    int n = selected.size();
+    std::vector<float> strengths(n);
+    std::vector<int> order(n);
+    for (int k = 0; k < n; k++) {
+        strengths[k] = selected[k].strength;
+        order[k] = k;
+    }
 
-        int x2 = std::min(std::max(j - padding2, 0), cols - side2);
-        int y2 = std::min(std::max(i - padding2, 0), rows - side2);
-        cv::rectangle(active, cv::Rect(x2, y2, side2, side2), WHITE, CV_FILLED);
+    // A heap yields feature points by decreasing strength, but only pays for
+    // the ones actually inspected: when a limit is set, the remainder is never
+    // sorted.
+    WeakerFeature weaker(strengths);
+    std::make_heap(order.begin(), order.end(), weaker);
+
+    List<FeaturePoint> disjoint;
+    ExclusionGrid active(size, padding);
+    for (std::vector<int>::iterator end = order.end(); end != order.begin(); --end) {
+        if (limit > 0 && disjoint.size() >= (size_t) limit) {
+            break;
+        }
+
+        std::pop_heap(order.begin(), end, weaker);
+        const FeaturePoint &feature = selected[*(end - 1)];
+        if (active.claim(feature.center)) {
+            disjoint.append(feature);
+        }
     }
 
     return disjoint;
 }
 
-static bool compareResponse(cv::KeyPoint a, cv::KeyPoint b) {
-    return (a.response > b.response);
+List<FeaturePoint> cight::selectDisjoint(Selector selector, const Frame &frame, int padding) {
+    return disjointSubset(selector(frame, padding), 0, frame.size(), padding);
 }
 
-List<FeaturePoint> cight::selectFAST(cv::FastFeatureDetector &detector, const cv::Mat &bgr, int padding) {
-    cv::Mat edges = filter::sobel(colors::grayscale(bgr));
-    List<cv::KeyPoint> keypoints;
-    detector.detect(edges, *keypoints);
-    clarus::sort(keypoints, compareResponse);
+List<FeaturePoint> cight::selectDisjointAtMost(Selector selector, int limit, const Frame &frame, int padding) {
+    return disjointSubset(selector(frame, padding), limit, frame.size(), padding);
+}
 
-    int rows = keypoints.size();
-    List<FeaturePoint> regions;
-    for (int k = 0; k < rows; k++) {
-        regions.append(FeaturePoint(keypoints[k], edges, padding));
-    }
+List<FeaturePoint> cight::selectFAST(cv::FastFeatureDetector &detector, const Frame &frame, int padding) {
+    SelectorPipeline<SourceFAST> pipeline((SourceFAST(detector)));
+    return pipeline(frame, padding);
+}
 
-    return regions;
+Selector cight::selectorFAST(const cv::FastFeatureDetector &detector) {
+    return cight::bindPipeline(SourceFAST(detector));
 }
 
 List<FeaturePoint> cight::selectGoodFeatures(
     cv::GoodFeaturesToTrackDetector &detector,
-    const cv::Mat &bgr,
+    const Frame &frame,
     int padding
 ) {
-    cv::Mat edges = filter::sobel(colors::grayscale(bgr));
-    List<cv::KeyPoint> keypoints;
-    detector.detect(edges, *keypoints);
-
-    int rows = keypoints.size();
-    List<FeaturePoint> regions;
-    for (int k = 0; k < rows; k++) {
-        regions.append(FeaturePoint(keypoints[k], edges, padding));
-    }
+    SelectorPipeline<SourceGoodFeatures> pipeline((SourceGoodFeatures(detector)));
+    return pipeline(frame, padding);
+}
 
-    return regions;
+Selector cight::selectorGoodFeatures(const cv::GoodFeaturesToTrackDetector &detector) {
+    return cight::bindPipeline(SourceGoodFeatures(detector));
 }
 
-static cv::Mat saturation_mask(const cv::Mat &bgr) {
-    cv::Mat grays = colors::saturation(bgr);
-    cv::normalize(grays, grays, 0, 255, CV_MINMAX);
+static cv::Mat saturation_mask(const Frame &frame) {
+    cv::Mat grays;
+    cv::normalize(frame.saturation(), grays, 0, 255, CV_MINMAX);
 
     cv::Mat binary;
     cv::threshold(grays, binary, 0, 255, cv::THRESH_BINARY + cv::THRESH_OTSU);
@@ -186,70 +268,110 @@ static cv::Mat boundaries(const cv::Mat &bgr, const cv::Mat &markers) {
     return borders;
 }
 
-static bool sort_points(const cv::Point3f &a, const cv::Point3f &b) {
-    return a.z > b.z;
+/*
+Returns the index of the first non-zero byte in the range <tt>[j, n)</tt> of the
+given row, or \c n if there is none. Zero runs are skipped a machine word at a
+time, which makes the scan cheap on the sparse masks produced by thresholding.
+*/
+static int nextHit(const uchar *row, int j, int n) {
+    for (; j < n && (j & 7) != 0; j++) {
+        if (row[j] != 0) {
+            return j;
+        }
+    }
+
+    for (uint64_t word; j + 8 <= n; j += 8) {
+        memcpy(&word, row + j, sizeof(word));
+        if (word != 0) {
+            break;
+        }
+    }
+
+    for (; j < n; j++) {
+        if (row[j] != 0) {
+            return j;
+        }
+    }
+
+    return n;
+}
+
+static List<FeaturePoint> candidatesToFeatures(const std::vector<Candidate> &candidates, const cv::Mat &image, int padding) {
+    List<FeaturePoint> features;
+    for (size_t k = 0, n = candidates.size(); k < n; k++) {
+        const Candidate &candidate = candidates[k];
+        features.append(FeaturePoint(candidate.x, candidate.y, candidate.strength, image, padding));
+    }
+
+    return features;
 }
 
-List<FeaturePoint> cight::selectDifference(cv::Mat &previous, float t, const cv::Mat &image, int padding) {
+List<FeaturePoint> cight::selectDifference(
+    cv::Mat &previous,
+    float t,
+    int cell,
+    int top,
+    int budget,
+    const Frame &frame,
+    int padding
+) {
+    const cv::Mat &image = frame.image();
     if (previous.empty()) {
         image.copyTo(previous);
         return List<FeaturePoint>();
     }
 
     cv::Mat data = images::difference(previous, image);
-    List<cv::Point3f> points;
-    int rows = data.rows;
-    int cols = data.cols;
-
-    List<FeaturePoint> features;
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            float v = data.at<int>(i, j);
-            if (v > t) {
-                features.append(FeaturePoint(j, i, image, padding));
-            }
+    cv::Mat mask;
+    cv::compare(data, t, mask, cv::CMP_GT);
+
+    CandidateGrid grid(data.size(), cell, top);
+    for (int i = 0, rows = mask.rows; i < rows; i++) {
+        const uchar *hits = mask.ptr<uchar>(i);
+        const int *values = data.ptr<int>(i);
+        for (int j = nextHit(hits, 0, mask.cols); j < mask.cols; j = nextHit(hits, j + 1, mask.cols)) {
+            grid.insert(j, i, values[j]);
         }
     }
 
     image.copyTo(previous);
-    return features;
+    return candidatesToFeatures(grid.select(budget), image, padding);
 }
 
-List<FeaturePoint> cight::selectAboveMean(const cv::Mat &image, int padding) {
+List<FeaturePoint> cight::selectAboveMean(int cell, int top, int budget, const Frame &frame, int padding) {
+    const cv::Mat &image = frame.image();
     double mean = clarus::mean(image);
-    List<cv::Point3f> points;
-    int rows = image.rows;
-    int cols = image.cols;
-
-    List<FeaturePoint> features;
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            float v = image.at<uint8_t>(i, j);
-            if (v > mean) {
-                features.append(FeaturePoint(j, i, image, padding));
-            }
+    cv::Mat mask;
+    cv::compare(image, mean, mask, cv::CMP_GT);
+
+    CandidateGrid grid(image.size(), cell, top);
+    for (int i = 0, rows = mask.rows; i < rows; i++) {
+        const uchar *hits = mask.ptr<uchar>(i);
+        const uchar *values = image.ptr<uchar>(i);
+        for (int j = nextHit(hits, 0, mask.cols); j < mask.cols; j = nextHit(hits, j + 1, mask.cols)) {
+            grid.insert(j, i, values[j] - mean);
         }
     }
 
-    return features;
+    return candidatesToFeatures(grid.select(budget), image, padding);
 }
 
 typedef std::vector<cv::Point> Contour;
 
-List<FeaturePoint> cight::selectSaturation(const cv::Mat &bgr, int padding) {
+List<FeaturePoint> cight::selectSaturation(const Frame &frame, int padding) {
     static cv::Scalar WHITE = cv::Scalar::all(255);
 
-    cv::Mat s = saturation_mask(bgr);
-    cv::Mat borders = boundaries(bgr, s);
+    cv::Mat s = saturation_mask(frame);
+    cv::Mat borders = boundaries(frame.image(), s);
 
     // Calculate contour vectors for the boundaries extracted above.
     std::vector<Contour> contours;
     std::vector<cv::Vec4i> hierarchy;
     cv::findContours(borders, contours, hierarchy, CV_RETR_LIST, CV_CHAIN_APPROX_SIMPLE);
 
-    int ceil = bgr.size().area();
+    int ceil = frame.size().area();
 
-    cv::Mat edges = filter::sobel(colors::grayscale(bgr));
+    const cv::Mat &edges = frame.sobel();
     List<FeaturePoint> regions;
     std::set<Point> unique;
     for (int i = 0, n = contours.size(); i < n; i++) {
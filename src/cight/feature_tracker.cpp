@@ -0,0 +1,181 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cight/feature_tracker.hpp>
+using cight::FeaturePoint;
+using cight::FeatureTracker;
+using cight::FeatureTrackerState;
+using cight::Frame;
+using cight::Selector;
+using clarus::List;
+
+#include <set>
+#include <utility>
+
+// Minimum score for a feature point found at its previous position to keep its patch.
+static const double REUSE_SCORE = 0.999;
+
+struct cight::FeatureTrackerState {
+    /** \brief Upstream selector. */
+    Selector selector;
+
+    /** \brief Transform returning the patch source derivative. */
+    Frame::Transform source;
+
+    /** \brief Maximum number of frames between selections. */
+    int interval;
+
+    /** \brief Search radius. */
+    int radius;
+
+    /** \brief Minimum correlation score. */
+    float threshold;
+
+    /** \brief Minimum fraction of selected feature points to keep tracking. */
+    float tolerance;
+
+    /** \brief Feature points from the last frame. */
+    List<FeaturePoint> features;
+
+    /** \brief Number of feature points returned by the last selection. */
+    int selected;
+
+    /** \brief Number of frames since the last selection. */
+    int age;
+
+    FeatureTrackerState(
+        Selector _selector,
+        Frame::Transform _source,
+        int _interval,
+        int _radius,
+        float _threshold,
+        float _tolerance
+    ):
+        selector(_selector),
+        source(_source),
+        interval(_interval),
+        radius(_radius),
+        threshold(_threshold),
+        tolerance(_tolerance),
+        selected(0),
+        age(0)
+    {
+        // Nothing to do.
+    }
+};
+
+FeatureTracker::FeatureTracker(
+    Selector selector,
+    Frame::Transform source,
+    int interval,
+    int radius,
+    float threshold,
+    float tolerance
+):
+    state(new FeatureTrackerState(selector, source, interval, radius, threshold, tolerance))
+{
+    // Nothing to do.
+}
+
+/*
+Searches for the given feature point around its last position. Returns the top-left
+corner of the best match and writes its score to the given reference, or returns
+(-1, -1) if the search area doesn't fit a whole patch.
+*/
+static cv::Point trackPoint(const FeaturePoint &point, const cv::Mat &image, int radius, double &score) {
+    const cv::Rect &bounds = point.bounds;
+    cv::Rect area(bounds.x - radius, bounds.y - radius, bounds.width + 2 * radius, bounds.height + 2 * radius);
+    area &= cv::Rect(0, 0, image.cols, image.rows);
+    if (area.width < bounds.width || area.height < bounds.height) {
+        return cv::Point(-1, -1);
+    }
+
+    cv::Mat region(image, area);
+    cv::Mat patch = point.patch;
+
+    // Template matching only supports 8-bit and single-precision data.
+    int depth = region.depth();
+    if ((depth != CV_8U && depth != CV_32F) || patch.depth() != depth) {
+        region.convertTo(region, CV_32F);
+        patch.convertTo(patch, CV_32F);
+    }
+
+    cv::Mat scores;
+    cv::matchTemplate(region, patch, scores, cv::TM_CCOEFF_NORMED);
+
+    cv::Point location;
+    cv::minMaxLoc(scores, NULL, &score, NULL, &location);
+    return cv::Point(area.x + location.x, area.y + location.y);
+}
+
+List<FeaturePoint> FeatureTracker::operator () (const Frame &frame, int padding) {
+    FeatureTrackerState &s = *state;
+    cv::Mat image = s.source(frame);
+
+    List<FeaturePoint> tracked;
+    if (s.features.size() > 0 && (s.interval <= 0 || s.age < s.interval)) {
+        std::set<std::pair<int, int> > taken;
+        for (int i = 0, n = s.features.size(); i < n; i++) {
+            const FeaturePoint &point = s.features[i];
+
+            double score = 0.0;
+            cv::Point corner = trackPoint(point, image, s.radius, score);
+
+            // Flat patches yield NaN scores, which also fail this test.
+            if (corner.x < 0 || !(score >= s.threshold)) {
+                continue;
+            }
+
+            std::pair<int, int> key(corner.x, corner.y);
+            if (!taken.insert(key).second) {
+                continue;
+            }
+
+            if (corner == point.bounds.tl() && score >= REUSE_SCORE) {
+                tracked.append(point);
+            }
+            else {
+                int x = corner.x + point.bounds.width / 2;
+                int y = corner.y + point.bounds.height / 2;
+                tracked.append(FeaturePoint(x, y, point.strength, image, padding));
+            }
+        }
+    }
+
+    if (tracked.size() > 0 && tracked.size() >= s.tolerance * s.selected) {
+        s.features = tracked;
+        s.age++;
+        return tracked;
+    }
+
+    s.features = s.selector(frame, padding);
+    s.selected = s.features.size();
+    s.age = 0;
+    return s.features;
+}
+
+int FeatureTracker::age() const {
+    return state->age;
+}
+
+void FeatureTracker::reset() {
+    state->features = List<FeaturePoint>();
+    state->selected = 0;
+    state->age = 0;
+}
@@ -0,0 +1,144 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cight/frame.hpp>
+using cight::Frame;
+
+#include <cight/transforms.hpp>
+
+#include <clarus/vision/colors.hpp>
+#include <clarus/vision/filters.hpp>
+
+#include <map>
+
+struct cight::FrameCache {
+    /** \brief Source image. */
+    cv::Mat image;
+
+    /** \brief Memoized derivatives, indexed by key. */
+    std::map<std::string, cv::Mat> derived;
+
+    /** \brief Memoized pyramid levels, indexed by level. */
+    std::map<int, Frame> levels;
+
+    FrameCache(const cv::Mat &_image):
+        image(_image)
+    {
+        // Nothing to do.
+    }
+};
+
+Frame::Frame():
+    cache(new FrameCache(cv::Mat()))
+{
+    // Nothing to do.
+}
+
+Frame::Frame(const cv::Mat &image):
+    cache(new FrameCache(image))
+{
+    // Nothing to do.
+}
+
+const cv::Mat &Frame::image() const {
+    return cache->image;
+}
+
+bool Frame::empty() const {
+    return cache->image.empty();
+}
+
+cv::Size Frame::size() const {
+    return cache->image.size();
+}
+
+const cv::Mat &Frame::derive(const std::string &key, Transform transform) const {
+    std::map<std::string, cv::Mat> &derived = cache->derived;
+    std::map<std::string, cv::Mat>::iterator i = derived.find(key);
+    if (i != derived.end()) {
+        return i->second;
+    }
+
+    // The transform is evaluated before the cache entry is created, since it may
+    // itself request (and thus insert) other derivatives.
+    cv::Mat value = transform(*this);
+    return (derived[key] = value);
+}
+
+static cv::Mat toGray(const Frame &frame) {
+    const cv::Mat &image = frame.image();
+    return (image.channels() == 1 ? image : colors::grayscale(image));
+}
+
+static cv::Mat toSobel(const Frame &frame) {
+    return filter::sobel(frame.gray());
+}
+
+static cv::Mat toScharr(const Frame &frame) {
+    cv::Mat grad;
+    cv::Sobel(frame.gray(), grad, CV_8U, 1, 0, CV_SCHARR);
+    return grad;
+}
+
+static cv::Mat toUpper(const Frame &frame) {
+    return cight::upper_half(frame.image());
+}
+
+static cv::Mat toSaturation(const Frame &frame) {
+    return colors::saturation(frame.image());
+}
+
+const cv::Mat &Frame::gray() const {
+    return derive("gray", toGray);
+}
+
+const cv::Mat &Frame::sobel() const {
+    return derive("sobel", toSobel);
+}
+
+const cv::Mat &Frame::scharr() const {
+    return derive("scharr", toScharr);
+}
+
+const cv::Mat &Frame::upper() const {
+    return derive("upper", toUpper);
+}
+
+const cv::Mat &Frame::saturation() const {
+    return derive("saturation", toSaturation);
+}
+
+Frame Frame::level(int n) const {
+    if (n <= 0) {
+        return *this;
+    }
+
+    std::map<int, Frame> &levels = cache->levels;
+    std::map<int, Frame>::iterator i = levels.find(n);
+    if (i != levels.end()) {
+        return i->second;
+    }
+
+    cv::Mat reduced;
+    cv::pyrDown(level(n - 1).image(), reduced);
+
+    Frame frame(reduced);
+    levels[n] = frame;
+    return frame;
+}
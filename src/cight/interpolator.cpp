@@ -56,6 +56,42 @@ cv::Point cight::linePn(const cv::Point3f &line, const cv::Size &size) {
     return linePn(line.x, line.y, line.z, size);
 }
 
+cv::Range cight::lineBand(const cv::Point3f &line, int x, int radius, int rows) {
+    int y = cvRound(line.y + (x - line.x) * line.z);
+    int start = std::min(std::max(y - radius, 0), rows);
+    int end = std::max(std::min(y + radius + 1, rows), start);
+    return cv::Range(start, end);
+}
+
+float cight::lineConfidence(const cv::Mat &similarities, const cv::Point3f &line) {
+    std::vector<int> columns;
+    for (int j = 0, n = similarities.cols; j < n; j++) {
+        columns.push_back(j);
+    }
+
+    return lineConfidence(similarities, line, columns);
+}
+
+float cight::lineConfidence(const cv::Mat &similarities, const cv::Point3f &line, const std::vector<int> &columns) {
+    double total = 0.0;
+    double near = 0.0;
+    for (int k = 0, m = columns.size(); k < m; k++) {
+        int j = columns[k];
+        if (j < std::max(0, (int) line.x) || j >= similarities.cols) {
+            continue;
+        }
+
+        cv::Mat column = similarities.col(j);
+        cv::Range band = lineBand(line, j, 1, similarities.rows);
+        total += cv::sum(column)[0];
+        if (band.start < band.end) {
+            near += cv::sum(column.rowRange(band.start, band.end))[0];
+        }
+    }
+
+    return (total > 0.0 ? near / total : 0.0);
+}
+
 static List<float> bestSlide(const cv::Mat &costs) {
     int rows = costs.rows;
     int cols = costs.cols;
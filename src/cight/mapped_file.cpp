@@ -0,0 +1,94 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cight/mapped_file.hpp>
+using cight::MappedFile;
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+struct cight::MappedRegion {
+    /** \brief Start of the mapped region. */
+    void *data;
+
+    /** \brief Size of the mapped region in bytes. */
+    size_t bytes;
+
+    MappedRegion(const std::string &path):
+        data(MAP_FAILED),
+        bytes(0)
+    {
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0) {
+            throw std::runtime_error("Cannot open file \"" + path + "\"");
+        }
+
+        struct stat status;
+        if (::fstat(file, &status) != 0) {
+            ::close(file);
+            throw std::runtime_error("Cannot read status of file \"" + path + "\"");
+        }
+
+        bytes = status.st_size;
+        if (bytes > 0) {
+            data = ::mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+        }
+
+        ::close(file);
+        if (bytes > 0 && data == MAP_FAILED) {
+            throw std::runtime_error("Cannot map file \"" + path + "\"");
+        }
+    }
+
+    ~MappedRegion() {
+        if (data != MAP_FAILED) {
+            ::munmap(data, bytes);
+        }
+    }
+};
+
+MappedFile::MappedFile() {
+    // Nothing to do.
+}
+
+MappedFile::MappedFile(const std::string &path):
+    region(new MappedRegion(path))
+{
+    // Nothing to do.
+}
+
+unsigned char *MappedFile::data() const {
+    if (empty()) {
+        return NULL;
+    }
+
+    return (unsigned char*) region->data;
+}
+
+size_t MappedFile::size() const {
+    return (region.get() != NULL ? region->bytes : 0);
+}
+
+bool MappedFile::empty() const {
+    return size() == 0;
+}
@@ -20,6 +20,9 @@ along with Cight. If not, see <http://www.gnu.org/licenses/>.
 #include <cight/memory.hpp>
 using cight::Memory;
 
+#include <cight/bit_image.hpp>
+using cight::BitImage;
+
 #include <cight/transforms.hpp>
 
 #include <clarus/core/list.hpp>
@@ -122,28 +125,113 @@ cv::Mat cight::change_average(const Memory &memory) {
     return change_count(memory) / (double) (memory.size() - 1);
 }
 
-cv::Mat cight::drift_edges(const Memory &memory) {
-    if (memory.size() == 0) {
-        throw std::runtime_error("Eye buffer is empty");
+// Binary mask packed for each image in the buffer.
+static cv::Mat edges_mask(const cv::Mat &image) {
+    return cight::binary_edges(image);
+}
+
+/*
+Calls the given accumulator on the packed masks of each pair of consecutive images
+in the buffer, returning the value of set mask pixels. Each image is masked and
+packed only once.
+*/
+template<class Accumulate> static double accumulate_masks(const Memory &memory, cv::Mat (*mask)(const cv::Mat &), Accumulate accumulate) {
+    if (memory.size() < 2) {
+        throw std::runtime_error("Eye buffer holds fewer than two images");
     }
 
-    cv::Mat u = binary_edges(memory.at(0));
-    cv::Mat v = binary_edges(memory.at(1));
+    BitImage u(mask(memory.at(0)));
+    BitImage v(mask(memory.at(1)));
 
     int n = memory.size();
-    cv::Mat total(u.size(), CV_32F, cv::Scalar::all(0));
+    double level = std::max(u.level(), v.level());
     for (int j = 1;;) {
-        total += images::convert(images::absdiff(u, v), CV_32F);
+        accumulate(u, v);
 
         if (++j >= n) {
             break;
         }
 
         std::swap(u, v);
-        v = binary_edges(memory.at(j));
+        v = BitImage(mask(memory.at(j)));
+        level = std::max(level, v.level());
     }
 
-    return total;
+    return level;
+}
+
+struct AccumulatePixels {
+    cv::Mat &counts;
+
+    AccumulatePixels(cv::Mat &_counts):
+        counts(_counts)
+    {
+        // Nothing to do.
+    }
+
+    void operator () (const BitImage &u, const BitImage &v) {
+        if (counts.empty()) {
+            counts = cv::Mat(u.rows(), u.cols(), CV_32S, cv::Scalar::all(0));
+        }
+
+        cight::accumulate_changes(u, v, counts);
+    }
+};
+
+struct AccumulateBins {
+    size_t bins;
+
+    cv::Mat &totals;
+
+    AccumulateBins(size_t _bins, cv::Mat &_totals):
+        bins(_bins),
+        totals(_totals)
+    {
+        // Nothing to do.
+    }
+
+    void operator () (const BitImage &u, const BitImage &v) {
+        cight::accumulate_changes(u, v, bins, totals);
+    }
+};
+
+cv::Mat cight::change_histogram(const Memory &memory, size_t bins) {
+    if (memory.size() < 2) {
+        throw std::runtime_error("Eye buffer holds fewer than two images");
+    }
+
+    cv::Mat u = memory.at(0);
+    cv::Mat v = memory.at(1);
+
+    int n = memory.size();
+    double level = 0.0;
+    cv::Mat totals(1, bins, CV_32S, cv::Scalar::all(0));
+    for (int j = 1;;) {
+        BitImage changes(filter::otsu(images::absdiff(u, v)));
+        cight::accumulate_bins(changes, bins, totals);
+        level = std::max(level, changes.level());
+
+        if (++j >= n) {
+            break;
+        }
+
+        std::swap(u, v);
+        v = memory.at(j);
+    }
+
+    return images::convert(totals, CV_32F) * level;
+}
+
+cv::Mat cight::drift_edges(const Memory &memory) {
+    cv::Mat counts;
+    double level = accumulate_masks(memory, edges_mask, AccumulatePixels(counts));
+    return images::convert(counts, CV_32F) * level;
+}
+
+cv::Mat cight::drift_edges_histogram(const Memory &memory, size_t bins) {
+    cv::Mat totals(1, bins, CV_32S, cv::Scalar::all(0));
+    double level = accumulate_masks(memory, edges_mask, AccumulateBins(bins, totals));
+    return images::convert(totals, CV_32F) * level;
 }
 
 cv::Mat cight::average_edges(const Memory &memory) {
@@ -23,7 +23,10 @@ using clarus::List;
 
 #include <stdexcept>
 
-MockMatcher::MockMatcher() {
+MockMatcher::MockMatcher():
+    offset(0),
+    next(0)
+{
     // Nothing to do.
 }
 
@@ -31,14 +34,47 @@ MockMatcher::MockMatcher(const std::string &path, const StreamTeach &_teach, con
     pairings(new std::ifstream(path.c_str())),
     teach(_teach),
     replay(_replay),
-    offset(0)
+    offset(0),
+    next(0)
 {
     while (teach.diffs.size() < teach.size) {
         teach.read();
     }
 }
 
+MockMatcher::MockMatcher(const PairingIndex &_index, const DifferenceSource &teachSource, const DifferenceSource &replaySource):
+    offset(0),
+    index(_index),
+    teachDiffs(teachSource),
+    replayDiffs(replaySource),
+    next(0)
+{
+    // Nothing to do.
+}
+
+void MockMatcher::seek(size_t k) {
+    next = k;
+}
+
 List<cv::Mat> MockMatcher::operator () () {
+    if (!teachDiffs.empty()) {
+        if (next >= index.size()) {
+            return List<cv::Mat>();
+        }
+
+        // As in text mode, the k-th pairing belongs to the k-th replay difference
+        // image, whatever the record's replay column says
+        cv::Mat replayed = replayDiffs(next);
+        cv::Mat taught = teachDiffs(index.teach(next));
+        next++;
+
+        if (replayed.empty() || taught.empty()) {
+            return List<cv::Mat>();
+        }
+
+        return (List<cv::Mat>(), replayed, taught);
+    }
+
     cv::Mat replayed = replay();
     if (replayed.empty()) {
         return List<cv::Mat>();
@@ -0,0 +1,127 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cight/pairing_index.hpp>
+using cight::PairingIndex;
+
+#include <clarus/core/list.hpp>
+using clarus::List;
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+static const char MAGIC[8] = {'C', 'I', 'G', 'H', 'T', 'P', 'I', 'X'};
+
+static const boost::uint32_t VERSION = 1;
+
+struct PairingHeader {
+    char magic[8];
+
+    boost::uint32_t version;
+
+    boost::uint32_t reserved;
+
+    boost::uint64_t count;
+};
+
+PairingIndex::PairingIndex():
+    records(NULL),
+    count(0)
+{
+    // Nothing to do.
+}
+
+PairingIndex::PairingIndex(const std::string &path):
+    mapping(path),
+    records(NULL),
+    count(0)
+{
+    if (mapping.size() < sizeof(PairingHeader)) {
+        throw std::runtime_error("Pairing index \"" + path + "\" is too short");
+    }
+
+    const PairingHeader *header = (const PairingHeader*) mapping.data();
+    if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION) {
+        throw std::runtime_error("File \"" + path + "\" is not a pairing index");
+    }
+
+    size_t available = (mapping.size() - sizeof(PairingHeader)) / (2 * sizeof(boost::int32_t));
+    if (header->count > available) {
+        throw std::runtime_error("Pairing index \"" + path + "\" is truncated");
+    }
+
+    records = (const boost::int32_t*) (header + 1);
+    count = header->count;
+}
+
+size_t PairingIndex::convert(const std::string &text, const std::string &binary) {
+    std::ifstream in(text.c_str());
+    if (!in) {
+        throw std::runtime_error("Cannot open pairing file \"" + text + "\"");
+    }
+
+    std::ofstream out(binary.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot create pairing index \"" + binary + "\"");
+    }
+
+    // The count is patched in once all records are written.
+    PairingHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.reserved = 0;
+    header.count = 0;
+    out.write((const char*) &header, sizeof(PairingHeader));
+
+    for (;;) {
+        List<int> indices;
+        if (!(in >> indices) || indices.size() < 2) {
+            break;
+        }
+
+        boost::int32_t record[2] = {indices[0], indices[1]};
+        out.write((const char*) record, sizeof(record));
+        header.count++;
+    }
+
+    out.seekp(0);
+    out.write((const char*) &header, sizeof(PairingHeader));
+    if (!out) {
+        throw std::runtime_error("Error writing pairing index \"" + binary + "\"");
+    }
+
+    return header.count;
+}
+
+size_t PairingIndex::size() const {
+    return count;
+}
+
+bool PairingIndex::empty() const {
+    return count == 0;
+}
+
+int PairingIndex::replay(size_t k) const {
+    return records[2 * k];
+}
+
+int PairingIndex::teach(size_t k) const {
+    return records[2 * k + 1];
+}
@@ -0,0 +1,355 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cight/route_file.hpp>
+using cight::RouteFile;
+using cight::RouteLayer;
+
+#include <cight/difference_stream.hpp>
+#include <cight/frame.hpp>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+static const char MAGIC[8] = {'C', 'I', 'G', 'H', 'T', 'R', 'T', 'E'};
+
+static const boost::uint32_t VERSION = 1;
+
+// Alignment of layer data and of every frame within it.
+static const size_t FRAME_ALIGNMENT = 64;
+
+// Alignment of every frame row.
+static const size_t ROW_ALIGNMENT = 16;
+
+struct cight::RouteHeader {
+    char magic[8];
+
+    boost::uint32_t version;
+
+    boost::uint32_t layers;
+
+    double threshold;
+
+    boost::int32_t level;
+
+    boost::int32_t reserved;
+};
+
+struct cight::RouteEntry {
+    boost::uint32_t layer;
+
+    boost::int32_t rows;
+
+    boost::int32_t cols;
+
+    boost::int32_t type;
+
+    boost::uint64_t count;
+
+    boost::uint64_t step;
+
+    boost::uint64_t stride;
+
+    boost::uint64_t offset;
+};
+
+/*
+Writes the frames of one layer to a temporary file, recording their common format.
+*/
+struct LayerWriter {
+    cight::RouteEntry entry;
+
+    std::string path;
+
+    std::ofstream out;
+
+    LayerWriter(RouteLayer layer, const std::string &_path):
+        path(_path),
+        out(_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc)
+    {
+        if (!out) {
+            throw std::runtime_error("Cannot create temporary file \"" + path + "\"");
+        }
+
+        std::memset(&entry, 0, sizeof(entry));
+        entry.layer = layer;
+    }
+
+    void write(const cv::Mat &frame) {
+        if (entry.count == 0) {
+            entry.rows = frame.rows;
+            entry.cols = frame.cols;
+            entry.type = frame.type();
+            entry.step = cv::alignSize(frame.cols * frame.elemSize(), ROW_ALIGNMENT);
+            entry.stride = cv::alignSize(entry.step * frame.rows, FRAME_ALIGNMENT);
+        }
+        else if (frame.rows != entry.rows || frame.cols != entry.cols || frame.type() != entry.type) {
+            throw std::runtime_error("Route layer frames must all be of the same size and type");
+        }
+
+        std::vector<char> padding(entry.stride, 0);
+        size_t bytes = frame.cols * frame.elemSize();
+        for (int i = 0; i < frame.rows; i++) {
+            out.write((const char*) frame.ptr(i), bytes);
+            out.write(&padding[0], entry.step - bytes);
+        }
+
+        out.write(&padding[0], entry.stride - entry.step * frame.rows);
+        entry.count++;
+    }
+};
+
+typedef boost::shared_ptr<LayerWriter> Writer;
+
+/*
+Sensor stream that passes frames through from another, writing per-frame layers on
+the way.
+*/
+struct RouteTap {
+    cight::SensorStream source;
+
+    Writer gray;
+
+    Writer edges;
+
+    Writer coarse;
+
+    Writer spectra;
+
+    int levels;
+
+    cv::Mat operator () () {
+        cv::Mat image = source();
+        if (image.empty()) {
+            return image;
+        }
+
+        cight::Frame frame(image);
+        gray->write(frame.gray());
+        edges->write(frame.sobel());
+        if (levels > 0) {
+            coarse->write(frame.level(levels).sobel());
+        }
+
+        if (spectra.get() != NULL) {
+            cv::Mat real;
+            cv::Mat spectrum;
+            frame.sobel().convertTo(real, CV_32F);
+            cv::dft(real, spectrum, cv::DFT_COMPLEX_OUTPUT);
+            spectra->write(spectrum);
+        }
+
+        return image;
+    }
+};
+
+static cv::Mat indexMatrix(int index) {
+    return cv::Mat(1, 1, CV_32S, cv::Scalar(index));
+}
+
+RouteFile::RouteFile():
+    header(NULL),
+    entries(NULL)
+{
+    // Nothing to do.
+}
+
+RouteFile::RouteFile(const std::string &path):
+    mapping(path),
+    header(NULL),
+    entries(NULL)
+{
+    const unsigned char *data = mapping.data();
+    size_t bytes = mapping.size();
+    if (bytes < sizeof(RouteHeader)) {
+        throw std::runtime_error("Route file \"" + path + "\" is too short");
+    }
+
+    header = (const RouteHeader*) data;
+    if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION) {
+        throw std::runtime_error("File \"" + path + "\" is not a route file");
+    }
+
+    entries = (const RouteEntry*) (header + 1);
+    if (bytes < sizeof(RouteHeader) + header->layers * sizeof(RouteEntry)) {
+        throw std::runtime_error("Route file \"" + path + "\" is truncated");
+    }
+
+    for (size_t l = 0; l < header->layers; l++) {
+        const RouteEntry &layer = entries[l];
+        if (layer.offset + layer.count * layer.stride > bytes) {
+            throw std::runtime_error("Route file \"" + path + "\" is truncated");
+        }
+    }
+}
+
+void RouteFile::compile(SensorStream stream, const std::string &path, double threshold, int levels, bool spectra) {
+    std::vector<Writer> writers;
+
+    RouteTap tap;
+    tap.source = stream;
+    tap.levels = levels;
+    tap.gray.reset(new LayerWriter(ROUTE_GRAY, path + ".gray"));
+    tap.edges.reset(new LayerWriter(ROUTE_EDGES, path + ".edges"));
+    writers.push_back(tap.gray);
+    writers.push_back(tap.edges);
+    if (levels > 0) {
+        tap.coarse.reset(new LayerWriter(ROUTE_COARSE, path + ".coarse"));
+        writers.push_back(tap.coarse);
+    }
+
+    if (spectra) {
+        tap.spectra.reset(new LayerWriter(ROUTE_SPECTRA, path + ".spectra"));
+        writers.push_back(tap.spectra);
+    }
+
+    Writer frames(new LayerWriter(ROUTE_FRAMES, path + ".frames"));
+    Writer indices(new LayerWriter(ROUTE_INDICES, path + ".indices"));
+    Writer diffs(new LayerWriter(ROUTE_DIFFS, path + ".diffs"));
+    writers.push_back(frames);
+    writers.push_back(indices);
+    writers.push_back(diffs);
+
+    // The difference stream pulls every frame through the tap, so both pipelines
+    // see the recording in a single pass.
+    DifferenceStream differences(SensorStream(tap), 1, threshold);
+    while (differences.read()) {
+        if (frames->entry.count == 0) {
+            frames->write(differences.frames[0]);
+            indices->write(indexMatrix(differences.indices[0]));
+        }
+
+        frames->write(differences.frames[-1]);
+        indices->write(indexMatrix(differences.indices[-1]));
+        diffs->write(differences.diffs[-1]);
+    }
+
+    if (frames->entry.count == 0 && differences.frames.size() > 0) {
+        frames->write(differences.frames[0]);
+        indices->write(indexMatrix(differences.indices[0]));
+    }
+
+    // Lay out the header, the layer table and then each layer's data.
+    RouteHeader head;
+    std::memcpy(head.magic, MAGIC, sizeof(MAGIC));
+    head.version = VERSION;
+    head.layers = writers.size();
+    head.threshold = threshold;
+    head.level = levels;
+    head.reserved = 0;
+
+    size_t offset = cv::alignSize(sizeof(RouteHeader) + writers.size() * sizeof(RouteEntry), FRAME_ALIGNMENT);
+    for (size_t l = 0; l < writers.size(); l++) {
+        LayerWriter &writer = *writers[l];
+        writer.out.close();
+        writer.entry.offset = offset;
+        offset += writer.entry.count * writer.entry.stride;
+    }
+
+    std::ofstream out(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot create route file \"" + path + "\"");
+    }
+
+    out.write((const char*) &head, sizeof(RouteHeader));
+    for (size_t l = 0; l < writers.size(); l++) {
+        out.write((const char*) &writers[l]->entry, sizeof(RouteEntry));
+    }
+
+    std::vector<char> padding(FRAME_ALIGNMENT, 0);
+    size_t written = sizeof(RouteHeader) + writers.size() * sizeof(RouteEntry);
+    out.write(&padding[0], cv::alignSize(written, FRAME_ALIGNMENT) - written);
+
+    for (size_t l = 0; l < writers.size(); l++) {
+        const LayerWriter &writer = *writers[l];
+        if (writer.entry.count > 0) {
+            std::ifstream in(writer.path.c_str(), std::ios::in | std::ios::binary);
+            out << in.rdbuf();
+        }
+
+        std::remove(writer.path.c_str());
+    }
+
+    if (!out) {
+        throw std::runtime_error("Error writing route file \"" + path + "\"");
+    }
+}
+
+const cight::RouteEntry *RouteFile::entry(RouteLayer layer) const {
+    if (header == NULL) {
+        return NULL;
+    }
+
+    for (size_t l = 0; l < header->layers; l++) {
+        if (entries[l].layer == (boost::uint32_t) layer) {
+            return &entries[l];
+        }
+    }
+
+    return NULL;
+}
+
+bool RouteFile::empty() const {
+    return header == NULL;
+}
+
+bool RouteFile::has(RouteLayer layer) const {
+    return entry(layer) != NULL;
+}
+
+size_t RouteFile::size(RouteLayer layer) const {
+    const RouteEntry *found = entry(layer);
+    return (found != NULL ? found->count : 0);
+}
+
+cv::Mat RouteFile::at(RouteLayer layer, size_t k) const {
+    const RouteEntry *found = entry(layer);
+    if (found == NULL || k >= found->count) {
+        throw std::runtime_error("Route frame out of range");
+    }
+
+    unsigned char *data = mapping.data() + found->offset + k * found->stride;
+    return cv::Mat(found->rows, found->cols, found->type, data, found->step);
+}
+
+cv::Mat RouteFile::frame(RouteLayer layer, int k) const {
+    if (k < 0 || (size_t) k >= size(layer)) {
+        return cv::Mat();
+    }
+
+    return at(layer, k);
+}
+
+int RouteFile::index(size_t k) const {
+    return at(ROUTE_INDICES, k).at<int>(0, 0);
+}
+
+double RouteFile::threshold() const {
+    return (header != NULL ? header->threshold : 0.0);
+}
+
+int RouteFile::level() const {
+    return (header != NULL && has(ROUTE_COARSE) ? header->level : 0);
+}
@@ -0,0 +1,87 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cight/shift_tracker.hpp>
+using cight::ShiftTracker;
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+ShiftTracker::ShiftTracker(int _minimum, float _gain, float _spread):
+    shift(0),
+    error(-1),
+    minimum(_minimum),
+    gain(_gain),
+    spread(_spread),
+    last(-1)
+{
+    // Nothing to do.
+}
+
+int ShiftTracker::offset() const {
+    return (int) std::floor(shift + 0.5f);
+}
+
+int ShiftTracker::radius(int padding) {
+    if (error < 0) {
+        last = -1;
+        return padding;
+    }
+
+    int r = (int) std::ceil(spread * error);
+    last = std::min(std::max(r, minimum), padding);
+    return last;
+}
+
+void ShiftTracker::update(const cv::Mat &displacements) {
+    int n = displacements.total();
+    if (n == 0) {
+        return;
+    }
+
+    const int *data = displacements.ptr<int>(0);
+    std::vector<int> values(data, data + n);
+    std::nth_element(values.begin(), values.begin() + n / 2, values.end());
+    float measured = values[n / 2];
+
+    float deviation = std::abs(measured - offset());
+    if (last >= 0 && deviation >= last) {
+        // The match sits at the edge of the search area, so the true shift may lie
+        // beyond it: re-center on it, but search the full padding again.
+        shift = measured;
+        error = -1;
+        return;
+    }
+
+    if (error < 0) {
+        error = deviation;
+    }
+    else {
+        error += gain * (deviation - error);
+    }
+
+    shift += gain * (measured - shift);
+}
+
+void ShiftTracker::reset() {
+    shift = 0;
+    error = -1;
+    last = -1;
+}
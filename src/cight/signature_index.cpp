@@ -0,0 +1,163 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cight/signature_index.hpp>
+using cight::SignatureIndex;
+using clarus::List;
+
+#include <cight/frame.hpp>
+#include <cight/transforms.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+/*
+Orders teach offsets by decreasing score.
+*/
+struct ScoreOrder {
+    const std::vector<float> &scores;
+
+    ScoreOrder(const std::vector<float> &_scores):
+        scores(_scores)
+    {
+        // Nothing to do.
+    }
+
+    bool operator () (int a, int b) const {
+        return scores[a] > scores[b];
+    }
+};
+
+SignatureIndex::SignatureIndex():
+    bins(0)
+{
+    // Nothing to do.
+}
+
+SignatureIndex::SignatureIndex(size_t _bins):
+    bins(_bins)
+{
+    // Nothing to do.
+}
+
+SignatureIndex::SignatureIndex(SensorStream stream, size_t _bins):
+    bins(_bins)
+{
+    for (;;) {
+        cight::Frame frame(stream());
+        if (frame.empty()) {
+            break;
+        }
+
+        append(frame.sobel());
+    }
+}
+
+SignatureIndex::SignatureIndex(const RouteFile &route, size_t _bins):
+    bins(_bins)
+{
+    for (size_t k = 0, n = route.size(cight::ROUTE_EDGES); k < n; k++) {
+        append(route.at(cight::ROUTE_EDGES, k));
+    }
+}
+
+cv::Mat SignatureIndex::signature(const cv::Mat &edges, size_t bins) {
+    if (bins == 0 || (size_t) edges.cols < bins) {
+        throw std::runtime_error("Signature bins must be between 1 and the image width");
+    }
+
+    cv::Mat histogram = cight::column_histogram(edges, bins);
+    histogram -= cv::mean(histogram);
+
+    double norm = cv::norm(histogram, cv::NORM_L2);
+    if (norm > 0) {
+        histogram /= norm;
+    }
+
+    return histogram;
+}
+
+void SignatureIndex::append(const cv::Mat &edges) {
+    signatures.push_back(signature(edges, bins));
+}
+
+size_t SignatureIndex::size() const {
+    return signatures.rows;
+}
+
+bool SignatureIndex::empty() const {
+    return signatures.rows == 0;
+}
+
+std::vector<int> SignatureIndex::nearest(const List<cv::Mat> &edges, size_t k, int spacing, std::vector<float> *scores) const {
+    std::vector<int> offsets;
+    int n = signatures.rows;
+    int m = std::min((int) edges.size(), n);
+    if (m == 0 || k == 0) {
+        return offsets;
+    }
+
+    cv::Mat queries(m, bins, CV_32F);
+    for (int j = 0; j < m; j++) {
+        cv::Mat row = queries.row(j);
+        signature(edges.at(j), bins).copyTo(row);
+    }
+
+    // Correlation of every teach frame (rows) against every query (columns).
+    cv::Mat correlations;
+    cv::gemm(signatures, queries, 1.0, cv::Mat(), 0.0, correlations, cv::GEMM_2_T);
+
+    // Score each offset by the mean correlation along its diagonal.
+    int count = n - m + 1;
+    std::vector<float> totals(count, 0.0f);
+    for (int t = 0; t < count; t++) {
+        float total = 0;
+        for (int j = 0; j < m; j++) {
+            total += correlations.at<float>(t + j, j);
+        }
+
+        totals[t] = total / m;
+    }
+
+    std::vector<int> order(count);
+    for (int t = 0; t < count; t++) {
+        order[t] = t;
+    }
+
+    std::stable_sort(order.begin(), order.end(), ScoreOrder(totals));
+
+    for (int i = 0; i < count && offsets.size() < k; i++) {
+        int t = order[i];
+        bool distinct = true;
+        for (size_t c = 0; c < offsets.size() && distinct; c++) {
+            distinct = (std::abs(offsets[c] - t) >= spacing);
+        }
+
+        if (distinct) {
+            offsets.push_back(t);
+            if (scores != NULL) {
+                scores->push_back(totals[t]);
+            }
+        }
+    }
+
+    return offsets;
+}
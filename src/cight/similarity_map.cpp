@@ -20,23 +20,45 @@ along with Cight. If not, see <http://www.gnu.org/licenses/>.
 #include <cight/similarity_map.hpp>
 using cight::SimilarityMap;
 
+#include <cight/interpolator.hpp>
+#include <cight/settings.hpp>
+
 #include <clarus/core/list.hpp>
 using clarus::List;
 
 #include <clarus/core/math.hpp>
 
-SimilarityMap::SimilarityMap() {
+#include <algorithm>
+#include <cmath>
+
+SimilarityMap::SimilarityMap():
+    since(0),
+    band(0),
+    radius(-1),
+    predicted(0, 0, 0),
+    confidence(0)
+{
     // Nothing to do.
 }
 
 SimilarityMap::SimilarityMap(int rows, int cols):
-    cv::Mat(rows, cols, CV_32F, cv::Scalar(0))
+    cv::Mat(rows, cols, CV_32F, cv::Scalar(0)),
+    since(0),
+    band(0),
+    radius(-1),
+    predicted(0, 0, 0),
+    confidence(0)
 {
     // Nothing to do.
 }
 
 SimilarityMap::SimilarityMap(const cv::Size &size):
-    cv::Mat(size, CV_32F, cv::Scalar(0))
+    cv::Mat(size, CV_32F, cv::Scalar(0)),
+    since(0),
+    band(0),
+    radius(-1),
+    predicted(0, 0, 0),
+    confidence(0)
 {
     // Nothing to do.
 }
@@ -47,6 +69,17 @@ bool SimilarityMap::update(StreamTeach &teach, StreamReplay &replay) {
 
     // Shift the similarity matrix to make room for new match estimations
     clarus::shift(*this, row0 - rows, col0 - cols);
+    predicted.x += col0 - cols;
+    predicted.y += row0 - rows;
+
+    // Discard cells of replay frames no longer in the buffer
+    while (cells.size() > (size_t) col0) {
+        cells.remove(0);
+        offsets.remove(0);
+        evaluated.remove(0);
+        searches.remove(0);
+        probes.remove(0);
+    }
 
     // Fill teach buffer to capacity
     for (int i = row0; i < rows; i++) {
@@ -55,18 +88,127 @@ bool SimilarityMap::update(StreamTeach &teach, StreamReplay &replay) {
         }
     }
 
-    // Collect replay images, filling the similarity matrix along the way
+    // Collect replay images, then fill the similarity matrix in one batch; if the
+    // replay stream runs out, columns for the images read so far are still filled
+    bool complete = true;
     for (int j = col0; j < cols; j++) {
         if (!replay.read()) {
-            return false;
+            complete = false;
+            break;
+        }
+    }
+
+    markProbes(replay.features.size());
+
+    // New columns are searched around the shift predicted by the tracker, which is
+    // then updated with their displacements
+    int shift = replay.tracker.offset();
+    int radius = replay.tracker.radius(teach.padding);
+    List<List<cv::Mat> > batch = cight::evaluateIncremental(replay.features, teach.window, teach.padding, rows - row0, cells, offsets, evaluated, searches, bands(), replay.exact, shift, radius);
+    for (int j = 0, n = batch.size(); j < n; j++) {
+        const cv::Mat &responses = batch[j][0];
+        if (j >= col0) {
+            replay.tracker.update(batch[j][2]);
         }
 
-        List<cv::Mat> results = replay(j, teach);
-        const cv::Mat &responses = results[0];
         cv::Rect roi(j, 0, 1, rows);
         cv::Mat column(*this, roi);
         responses.copyTo(column);
     }
 
-    return true;
+    return complete;
+}
+
+void SimilarityMap::fit(const cv::Point3f &line) {
+    std::vector<int> columns;
+    for (int j = 0, n = probes.size(); j < n; j++) {
+        if (probes[j] != 0) {
+            columns.push_back(j);
+        }
+    }
+
+    predicted = line;
+    confidence = (columns.empty() ? cight::lineConfidence(*this, line) : cight::lineConfidence(*this, line, columns));
+    radius = std::max(BAND_MIN_RADIUS, cvRound(band * (1.0 - confidence)));
+}
+
+void SimilarityMap::markProbes(int columns) {
+    bool banded = (band > 0 && radius >= 0);
+    for (int j = probes.size(); j < columns; j++) {
+        bool probe = (!banded || ++since >= std::min(BAND_PROBE_PERIOD, cols));
+        if (probe) {
+            since = 0;
+        }
+
+        probes.append(probe ? 1 : 0);
+    }
+}
+
+std::vector<cv::Range> SimilarityMap::bands() const {
+    std::vector<cv::Range> ranges;
+    if (band <= 0 || radius < 0) {
+        return ranges;
+    }
+
+    for (int j = 0; j < cols; j++) {
+        if (j < (int) probes.size() && probes[j] != 0) {
+            ranges.push_back(cv::Range(0, rows));
+        }
+        else {
+            ranges.push_back(cight::lineBand(predicted, j, radius, rows));
+        }
+    }
+
+    return ranges;
+}
+
+void SimilarityMap::resizeWindow(const cv::Size &size) {
+    int dy = size.height - rows;
+    int dx = size.width - cols;
+    if (dy == 0 && dx == 0) {
+        return;
+    }
+
+    cv::Mat::operator = (cight::anchorCorner(*this, size.height, size.width));
+    predicted.x += dx;
+    predicted.y += dy;
+
+    while (cells.size() > (size_t) size.width) {
+        cells.remove(0);
+        offsets.remove(0);
+        evaluated.remove(0);
+        searches.remove(0);
+        probes.remove(0);
+    }
+
+    for (int j = 0, n = cells.size(); j < n; j++) {
+        cells[j] = cight::anchorCorner(cells[j], size.height, cells[j].cols);
+        offsets[j] = cight::anchorCorner(offsets[j], size.height, offsets[j].cols);
+        evaluated[j] = cight::anchorCorner(evaluated[j], size.height, evaluated[j].cols);
+    }
+}
+
+cv::Mat cight::anchorCorner(const cv::Mat &matrix, int rows, int cols) {
+    cv::Mat anchored(rows, cols, matrix.type(), cv::Scalar::all(0));
+    int height = std::min(rows, matrix.rows);
+    int width = std::min(cols, matrix.cols);
+    if (height > 0 && width > 0) {
+        cv::Mat source(matrix, cv::Rect(matrix.cols - width, matrix.rows - height, width, height));
+        source.copyTo(cv::Mat(anchored, cv::Rect(cols - width, rows - height, width, height)));
+    }
+
+    return anchored;
+}
+
+cv::Size cight::adaptWindow(const cv::Point3f &line, float confidence, const cv::Size &minimum, const cv::Size &maximum) {
+    float slack = 1.0f - std::min(std::max(confidence, 0.0f), 1.0f);
+    int width = cvRound(minimum.width + slack * (maximum.width - minimum.width));
+    int height = cvRound(minimum.height + slack * (maximum.height - minimum.height));
+
+    // The teach window must be tall enough to span the replay window at the fitted slope.
+    height = std::max(height, cvCeil(std::fabs(line.z) * width) + 1);
+
+    width = std::min(std::max(width, minimum.width), maximum.width);
+    height = std::min(std::max(height, minimum.height), maximum.height);
+    return cv::Size(width, height);
 }
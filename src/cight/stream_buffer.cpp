@@ -35,6 +35,13 @@ void StreamBuffer::pop() {
     frames.remove(0);
 }
 
+void StreamBuffer::resize(size_t _size) {
+    size = _size;
+    while (frames.size() > size) {
+        pop();
+    }
+}
+
 bool StreamBuffer::read() {
     cv::Mat frame = stream();
     if (frame.empty()) {
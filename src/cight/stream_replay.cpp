@@ -22,7 +22,8 @@ using cight::StreamReplay;
 using clarus::List;
 
 StreamReplay::StreamReplay():
-    DifferenceStream()
+    DifferenceStream(),
+    exact(false)
 {
     // Nothing to do.
 }
@@ -30,7 +31,8 @@ StreamReplay::StreamReplay():
 StreamReplay::StreamReplay(SensorStream stream, size_t size, double threshold, Selector _selector, int _padding):
     DifferenceStream(stream, size, threshold),
     selector(_selector),
-    padding(_padding)
+    padding(_padding),
+    exact(false)
 {
     // Nothing to do.
 }
@@ -41,7 +43,21 @@ cv::Mat StreamReplay::operator () () {
 
 List<cv::Mat> StreamReplay::operator () (int j, StreamTeach &teach) {
     const FeatureMap &featured = features.at(j);
-    List<cv::Mat> results = featured(teach.diffs, teach.padding);
+    int shift = tracker.offset();
+    int radius = tracker.radius(teach.padding);
+    List<cv::Mat> results = featured(teach.window, teach.padding, 0, 0, exact, shift, radius);
+    tracker.update(results[2]);
+    return results;
+}
+
+List<List<cv::Mat> > StreamReplay::operator () (int j0, int j1, StreamTeach &teach) {
+    int shift = tracker.offset();
+    int radius = tracker.radius(teach.padding);
+    List<List<cv::Mat> > results = cight::evaluateBatch(features, j0, j1, teach.window, teach.padding, exact, shift, radius);
+    for (int j = 0, n = results.size(); j < n; j++) {
+        tracker.update(results[j][2]);
+    }
+
     return results;
 }
 
@@ -26,9 +26,46 @@ StreamTeach::StreamTeach():
     // Nothing to do.
 }
 
-StreamTeach::StreamTeach(SensorStream stream, size_t size, double threshold, int _padding):
+StreamTeach::StreamTeach(SensorStream stream, size_t size, double threshold, int _padding, Comparator comparator):
     DifferenceStream(stream, size, threshold),
+    window(size, comparator),
     padding(_padding)
 {
     // Nothing to do.
 }
+
+StreamTeach::StreamTeach(const RouteFile &route, size_t size, int _padding, Comparator comparator):
+    DifferenceStream(route, size),
+    window(size, comparator),
+    padding(_padding)
+{
+    // Nothing to do.
+}
+
+void StreamTeach::pop() {
+    DifferenceStream::pop();
+    window.pop();
+}
+
+bool StreamTeach::read() {
+    if (!DifferenceStream::read()) {
+        return false;
+    }
+
+    window.append(diffs.at(-1));
+    if (window.comparator() != CENSUS) {
+        diffs.at(-1) = window.at(-1);
+    }
+
+    return true;
+}
+
+void StreamTeach::resize(size_t size) {
+    DifferenceStream::resize(size);
+    window.resize(size);
+    if (window.comparator() != CENSUS) {
+        for (int i = 0, n = diffs.size(); i < n; i++) {
+            diffs.at(i) = window.at(i);
+        }
+    }
+}
@@ -0,0 +1,580 @@
+/*
+Copyright (c) Helio Perroni Filho <xperroni@gmail.com>
+
+This file is part of Cight.
+
+Cight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cight. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cight/teach_window.hpp>
+using cight::Comparator;
+using cight::TeachWindow;
+
+#include <cight/bit_image.hpp>
+#include <cight/transforms.hpp>
+
+#include <clarus/core/math.hpp>
+#include <clarus/vision/fourier.hpp>
+
+#include <boost/cstdint.hpp>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+TeachWindow::TeachWindow():
+    slots(0),
+    origin(0),
+    count(0),
+    frame(0, 0),
+    method(CORRELATION)
+{
+    // Nothing to do.
+}
+
+TeachWindow::TeachWindow(size_t capacity, Comparator comparator):
+    integrated(capacity, false),
+    slots(capacity),
+    origin(0),
+    count(0),
+    frame(0, 0),
+    method(comparator)
+{
+    // Nothing to do.
+}
+
+TeachWindow::TeachWindow(const TeachWindow &that):
+    buffer(that.buffer.clone()),
+    squares(that.squares.clone()),
+    integrated(that.integrated),
+    slots(that.slots),
+    origin(that.origin),
+    count(that.count),
+    frame(that.frame),
+    method(that.method)
+{
+    // Nothing to do.
+}
+
+TeachWindow &TeachWindow::operator = (const TeachWindow &that) {
+    if (this != &that) {
+        buffer = that.buffer.clone();
+        squares = that.squares.clone();
+        integrated = that.integrated;
+        slots = that.slots;
+        origin = that.origin;
+        count = that.count;
+        frame = that.frame;
+        method = that.method;
+    }
+
+    return *this;
+}
+
+void TeachWindow::append(const cv::Mat &input) {
+    if (slots == 0) {
+        throw std::runtime_error("Teach window has zero capacity");
+    }
+
+    cv::Mat image = (method == CENSUS ? cight::census(input) : input);
+
+    if (buffer.empty()) {
+        size_t element = image.elemSize();
+        size_t bytes = cv::alignSize(image.cols * element, 16);
+        int stride = (bytes % element == 0 ? bytes / element : image.cols);
+        buffer = cv::Mat(slots * image.rows, stride, image.type(), cv::Scalar::all(0));
+        frame = image.size();
+    }
+    else if (image.size() != frame || image.type() != buffer.type()) {
+        throw std::runtime_error("Teach window frames must all be of the same size and type");
+    }
+
+    if (count == slots) {
+        pop();
+    }
+
+    size_t slot = (origin + count) % slots;
+    cv::Mat slice(buffer, cv::Rect(0, slot * frame.height, frame.width, frame.height));
+    image.copyTo(slice);
+    integrated[slot] = false;
+
+    count++;
+}
+
+void TeachWindow::pop() {
+    if (count == 0) {
+        return;
+    }
+
+    origin = (origin + 1) % slots;
+    count--;
+}
+
+void TeachWindow::clear() {
+    origin = 0;
+    count = 0;
+}
+
+void TeachWindow::resize(size_t capacity) {
+    if (capacity == 0) {
+        throw std::runtime_error("Teach window has zero capacity");
+    }
+
+    if (capacity == slots) {
+        return;
+    }
+
+    while (count > capacity) {
+        pop();
+    }
+
+    if (!buffer.empty()) {
+        int height = frame.height;
+        cv::Mat frames(capacity * height, buffer.cols, buffer.type(), cv::Scalar::all(0));
+        for (size_t i = 0; i < count; i++) {
+            size_t slot = (origin + i) % slots;
+            cv::Mat(buffer, cv::Rect(0, slot * height, buffer.cols, height)).copyTo(
+                cv::Mat(frames, cv::Rect(0, i * height, buffer.cols, height))
+            );
+        }
+
+        buffer = frames;
+    }
+
+    // Integral images are recomputed on demand against the new layout.
+    squares = cv::Mat();
+    integrated.assign(capacity, false);
+
+    slots = capacity;
+    origin = 0;
+}
+
+cv::Mat TeachWindow::at(int i) const {
+    size_t slot = (origin + (i < 0 ? count + i : i)) % slots;
+    return cv::Mat(buffer, cv::Rect(0, slot * frame.height, frame.width, frame.height));
+}
+
+const uchar *TeachWindow::data(int i) const {
+    size_t slot = (origin + (i < 0 ? count + i : i)) % slots;
+    return buffer.ptr(slot * frame.height);
+}
+
+cv::Mat TeachWindow::integralSquares(int i) const {
+    size_t slot = (origin + (i < 0 ? count + i : i)) % slots;
+    if (squares.empty()) {
+        squares = cv::Mat(slots * (frame.height + 1), frame.width + 1, CV_64F, cv::Scalar::all(0));
+    }
+
+    cv::Mat squared(squares, cv::Rect(0, slot * (frame.height + 1), frame.width + 1, frame.height + 1));
+    if (!integrated[slot]) {
+        cv::Mat sums;
+        cv::integral(at(i), sums, squared, CV_64F);
+        integrated[slot] = true;
+    }
+
+    return squared;
+}
+
+size_t TeachWindow::step() const {
+    return buffer.step;
+}
+
+Comparator TeachWindow::comparator() const {
+    return method;
+}
+
+int TeachWindow::type() const {
+    return buffer.type();
+}
+
+cv::Size TeachWindow::frameSize() const {
+    return frame;
+}
+
+size_t TeachWindow::size() const {
+    return count;
+}
+
+size_t TeachWindow::capacity() const {
+    return slots;
+}
+
+bool TeachWindow::empty() const {
+    return count == 0;
+}
+
+void cight::correlateFourier(
+    const cv::Mat &patch,
+    const TeachWindow &window,
+    const cv::Rect &neighborhood,
+    int i0,
+    int n,
+    cv::Mat &peaks,
+    int column,
+    cv::Mat *offsets,
+    int first
+) {
+    for (int i = i0; i < n; i++) {
+        cv::Mat area(window.at(i), neighborhood);
+        cv::Mat responses = fourier::correlate(area, patch);
+        peaks.at<float>(i - first, column) = clarus::max(responses);
+        if (offsets != NULL) {
+            offsets->at<int>(i - first, column) = neighborhood.x + clarus::argmax(responses).x;
+        }
+    }
+}
+
+template<class T> static void correlateFrames(
+    const cv::Mat &patch,
+    const TeachWindow &window,
+    const cv::Rect &neighborhood,
+    int i0,
+    int n,
+    cv::Mat &peaks,
+    int column,
+    cv::Mat *offsets,
+    int first
+) {
+    int frames = n - i0;
+    if (frames <= 0) {
+        return;
+    }
+
+    cv::Mat kernel;
+    patch.convertTo(kernel, CV_32F);
+
+    int rows = kernel.rows;
+    int cols = kernel.cols;
+    int steps = window.step() / sizeof(T);
+
+    // Frame base pointers, offset to the neighborhood's top-left corner. These
+    // absorb the window's ring origin, so the rest of the pass can ignore it.
+    std::vector<const T*> bases(frames);
+    for (int f = 0; f < frames; f++) {
+        const T *base = (const T*) window.data(i0 + f);
+        bases[f] = base + neighborhood.y * steps + neighborhood.x;
+    }
+
+    std::vector<float> best(frames, -FLT_MAX);
+    std::vector<int> where(frames, 0);
+    std::vector<float> totals(frames);
+    for (int y = 0, yn = neighborhood.height - rows; y <= yn; y++) {
+        for (int x = 0, xn = neighborhood.width - cols; x <= xn; x++) {
+            std::fill(totals.begin(), totals.end(), 0.0f);
+            for (int v = 0; v < rows; v++) {
+                const float *values = kernel.ptr<float>(v);
+                int offset = (y + v) * steps + x;
+                for (int u = 0; u < cols; u++) {
+                    float p = values[u];
+                    int k = offset + u;
+                    for (int f = 0; f < frames; f++) {
+                        totals[f] += p * bases[f][k];
+                    }
+                }
+            }
+
+            for (int f = 0; f < frames; f++) {
+                if (best[f] < totals[f]) {
+                    best[f] = totals[f];
+                    where[f] = x;
+                }
+            }
+        }
+    }
+
+    for (int f = 0; f < frames; f++) {
+        peaks.at<float>(i0 + f - first, column) = best[f];
+    }
+
+    if (offsets != NULL) {
+        for (int f = 0; f < frames; f++) {
+            offsets->at<int>(i0 + f - first, column) = neighborhood.x + where[f];
+        }
+    }
+}
+
+/*
+Number of frames whose dot products are accumulated together by dots(). Eight
+accumulators plus the widened patch bytes fit in the SSE2 registers of x86-64.
+*/
+static const int DOT_FRAMES = 8;
+
+/*
+Writes to totals[f] the dot product of a patch and the same-sized image block at
+blocks[f], for each of count <= DOT_FRAMES blocks of given rows and columns. The
+frame loop is innermost, so each patch chunk is loaded and widened once for all
+blocks. With SSE2, bytes are widened to 16 bits and multiplied-added in pairs into
+32-bit lanes, sixteen (then eight) bytes at a time; lane sums are carried across all
+rows and reduced once at the end. Bytes left over at the end of each row are
+handled one by one.
+*/
+static inline void dots(
+    const uchar *patch,
+    size_t stride,
+    const uchar *const *blocks,
+    int count,
+    size_t step,
+    int rows,
+    int cols,
+    int *totals
+) {
+    for (int f = 0; f < count; f++) {
+        totals[f] = 0;
+    }
+
+#ifdef __SSE2__
+    __m128i zero = _mm_setzero_si128();
+    __m128i sums[DOT_FRAMES];
+    for (int f = 0; f < count; f++) {
+        sums[f] = zero;
+    }
+#endif
+
+    for (int v = 0; v < rows; v++) {
+        const uchar *a = patch + v * stride;
+        size_t offset = v * step;
+        int k = 0;
+
+#ifdef __SSE2__
+        for (; k + 16 <= cols; k += 16) {
+            __m128i u = _mm_loadu_si128((const __m128i*) (a + k));
+            __m128i lo = _mm_unpacklo_epi8(u, zero);
+            __m128i hi = _mm_unpackhi_epi8(u, zero);
+            for (int f = 0; f < count; f++) {
+                __m128i w = _mm_loadu_si128((const __m128i*) (blocks[f] + offset + k));
+                sums[f] = _mm_add_epi32(sums[f], _mm_madd_epi16(lo, _mm_unpacklo_epi8(w, zero)));
+                sums[f] = _mm_add_epi32(sums[f], _mm_madd_epi16(hi, _mm_unpackhi_epi8(w, zero)));
+            }
+        }
+
+        for (; k + 8 <= cols; k += 8) {
+            __m128i lo = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (a + k)), zero);
+            for (int f = 0; f < count; f++) {
+                __m128i w = _mm_loadl_epi64((const __m128i*) (blocks[f] + offset + k));
+                sums[f] = _mm_add_epi32(sums[f], _mm_madd_epi16(lo, _mm_unpacklo_epi8(w, zero)));
+            }
+        }
+#endif
+
+        for (; k < cols; k++) {
+            int p = a[k];
+            for (int f = 0; f < count; f++) {
+                totals[f] += p * blocks[f][offset + k];
+            }
+        }
+    }
+
+#ifdef __SSE2__
+    for (int f = 0; f < count; f++) {
+        __m128i lanes = sums[f];
+        lanes = _mm_add_epi32(lanes, _mm_shuffle_epi32(lanes, _MM_SHUFFLE(1, 0, 3, 2)));
+        lanes = _mm_add_epi32(lanes, _mm_shuffle_epi32(lanes, _MM_SHUFFLE(2, 3, 0, 1)));
+        totals[f] += _mm_cvtsi128_si32(lanes);
+    }
+#endif
+}
+
+/*
+Integer version of correlateFrames() for 8-bit patches and frames. Dot products of
+up to 33025 byte pairs fit in 32 bits, which covers any practical patch size.
+
+As in correlateFrames(), frames are the innermost loop: they are evaluated in blocks
+of DOT_FRAMES, each block in a single pass over the neighborhood.
+*/
+static void correlateFrames8U(
+    const cv::Mat &patch,
+    const TeachWindow &window,
+    const cv::Rect &neighborhood,
+    int i0,
+    int n,
+    cv::Mat &peaks,
+    int column,
+    cv::Mat *offsets,
+    int first
+) {
+    int rows = patch.rows;
+    int cols = patch.cols;
+    size_t step = window.step();
+
+    const uchar *bases[DOT_FRAMES];
+    const uchar *blocks[DOT_FRAMES];
+    int totals[DOT_FRAMES];
+    int best[DOT_FRAMES];
+    int where[DOT_FRAMES];
+
+    for (int i = i0; i < n; i += DOT_FRAMES) {
+        int count = std::min(DOT_FRAMES, n - i);
+        for (int f = 0; f < count; f++) {
+            bases[f] = window.data(i + f) + neighborhood.y * step + neighborhood.x;
+            best[f] = INT_MIN;
+            where[f] = 0;
+        }
+
+        for (int y = 0, yn = neighborhood.height - rows; y <= yn; y++) {
+            for (int x = 0, xn = neighborhood.width - cols; x <= xn; x++) {
+                for (int f = 0; f < count; f++) {
+                    blocks[f] = bases[f] + y * step + x;
+                }
+
+                dots(patch.ptr<uchar>(0), patch.step, blocks, count, step, rows, cols, totals);
+                for (int f = 0; f < count; f++) {
+                    if (best[f] < totals[f]) {
+                        best[f] = totals[f];
+                        where[f] = x;
+                    }
+                }
+            }
+        }
+
+        for (int f = 0; f < count; f++) {
+            peaks.at<int>(i + f - first, column) = best[f];
+            if (offsets != NULL) {
+                offsets->at<int>(i + f - first, column) = neighborhood.x + where[f];
+            }
+        }
+    }
+}
+
+void cight::correlateWindow(
+    const cv::Mat &patch,
+    const TeachWindow &window,
+    const cv::Rect &neighborhood,
+    int i0,
+    int n,
+    cv::Mat &peaks,
+    int column,
+    cv::Mat *offsets,
+    int first
+) {
+    if (patch.channels() != 1 || CV_MAT_CN(window.type()) != 1) {
+        throw std::runtime_error("Patch and teach frames must be single-channel images");
+    }
+
+    if (peaks.type() == CV_32S) {
+        if (patch.type() != CV_8U || window.type() != CV_8U) {
+            throw std::runtime_error("Integer correlation requires 8-bit patches and teach frames");
+        }
+
+        correlateFrames8U(patch, window, neighborhood, i0, n, peaks, column, offsets, first);
+        return;
+    }
+
+    switch (CV_MAT_DEPTH(window.type())) {
+        case CV_8U:  correlateFrames<uchar>(patch, window, neighborhood, i0, n, peaks, column, offsets, first); break;
+        case CV_16U: correlateFrames<ushort>(patch, window, neighborhood, i0, n, peaks, column, offsets, first); break;
+        case CV_16S: correlateFrames<short>(patch, window, neighborhood, i0, n, peaks, column, offsets, first); break;
+        case CV_32S: correlateFrames<int>(patch, window, neighborhood, i0, n, peaks, column, offsets, first); break;
+        case CV_32F: correlateFrames<float>(patch, window, neighborhood, i0, n, peaks, column, offsets, first); break;
+        case CV_64F: correlateFrames<double>(patch, window, neighborhood, i0, n, peaks, column, offsets, first); break;
+        default: throw std::runtime_error("Unsupported teach frame depth");
+    }
+}
+
+/*
+Returns the Hamming distance between two byte strings of given length, comparing
+eight bytes at a time.
+*/
+static inline int hamming(const uchar *a, const uchar *b, int length) {
+    int distance = 0;
+    int k = 0;
+    for (; k + 8 <= length; k += 8) {
+        boost::uint64_t u, v;
+        std::memcpy(&u, a + k, 8);
+        std::memcpy(&v, b + k, 8);
+        distance += cight::popcount(u ^ v);
+    }
+
+    for (; k < length; k++) {
+        distance += cight::popcount(a[k] ^ b[k]);
+    }
+
+    return distance;
+}
+
+void cight::matchCensus(
+    const cv::Mat &codes,
+    const TeachWindow &window,
+    const cv::Rect &neighborhood,
+    int i0,
+    int n,
+    cv::Mat &peaks,
+    int column,
+    cv::Mat *offsets,
+    int first
+) {
+    if (codes.type() != CV_8U || window.type() != CV_8U) {
+        throw std::runtime_error("Census patch and teach frames must be of type CV_8U");
+    }
+
+    int rows = codes.rows;
+    int cols = codes.cols;
+    int bits = 8 * rows * cols;
+    size_t step = window.step();
+
+    for (int i = i0; i < n; i++) {
+        const uchar *base = window.data(i) + neighborhood.y * step + neighborhood.x;
+
+        int best = -1;
+        int where = 0;
+        for (int y = 0, yn = neighborhood.height - rows; y <= yn; y++) {
+            for (int x = 0, xn = neighborhood.width - cols; x <= xn; x++) {
+                int distance = 0;
+                for (int v = 0; v < rows; v++) {
+                    distance += hamming(codes.ptr<uchar>(v), base + (y + v) * step + x, cols);
+                }
+
+                int score = bits - distance;
+                if (best < score) {
+                    best = score;
+                    where = x;
+                }
+            }
+        }
+
+        peaks.at<float>(i - first, column) = best;
+        if (offsets != NULL) {
+            offsets->at<int>(i - first, column) = neighborhood.x + where;
+        }
+    }
+}
+
+float cight::correlationBound(
+    float norm,
+    const cv::Size &patch,
+    const TeachWindow &window,
+    const cv::Rect &neighborhood,
+    int i
+) {
+    cv::Mat squares = window.integralSquares(i);
+
+    double energy = 0.0;
+    for (int y = neighborhood.y, yn = neighborhood.y + neighborhood.height - patch.height; y <= yn; y++) {
+        const double *top = squares.ptr<double>(y);
+        const double *bottom = squares.ptr<double>(y + patch.height);
+        for (int x = neighborhood.x, xn = neighborhood.x + neighborhood.width - patch.width; x <= xn; x++) {
+            int x1 = x + patch.width;
+            double region = bottom[x1] - bottom[x] - top[x1] + top[x];
+            energy = std::max(energy, region);
+        }
+    }
+
+    return norm * std::sqrt(energy);
+}
@@ -3,8 +3,35 @@
 #include <clarus/vision/colors.hpp>
 #include <clarus/vision/filters.hpp>
 
-cv::Mat cight::binary_edges(const cv::Mat &bgr) {
-    return filter::otsu(filter::sobel(colors::grayscale(bgr)));
+cv::Mat cight::binary_edges(const Frame &frame) {
+    return filter::otsu(frame.sobel());
+}
+
+cv::Mat cight::census(const cv::Mat &image) {
+    int rows = image.rows;
+    int cols = image.cols;
+
+    cv::Mat padded;
+    cv::copyMakeBorder(image, padded, 1, 1, 1, 1, cv::BORDER_REPLICATE);
+    cv::Mat center(padded, cv::Rect(1, 1, cols, rows));
+
+    cv::Mat codes(rows, cols, CV_8U, cv::Scalar(0));
+    cv::Mat lower;
+    for (int dy = -1, bit = 0; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            if (dx == 0 && dy == 0) {
+                continue;
+            }
+
+            cv::Mat neighbor(padded, cv::Rect(1 + dx, 1 + dy, cols, rows));
+            cv::compare(neighbor, center, lower, cv::CMP_LT);
+            cv::bitwise_and(lower, cv::Scalar(1 << bit), lower);
+            cv::bitwise_or(codes, lower, codes);
+            bit++;
+        }
+    }
+
+    return codes;
 }
 
 cv::Mat cight::column_histogram(const cv::Mat &image, size_t bins) {
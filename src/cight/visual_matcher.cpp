@@ -20,9 +20,17 @@ along with Cight. If not, see <http://www.gnu.org/licenses/>.
 #include <cight/visual_matcher.hpp>
 using cight::StreamBuffer;
 using cight::StreamTeachV;
+using cight::TeachFrameV;
+using cight::ReplayFrameV;
+using cight::Selector;
+using cight::SensorStream;
+using cight::SignatureIndex;
 using cight::StreamReplayV;
 using cight::SimilarityMapV;
 using cight::VisualMatcher;
+using cight::FeatureMap;
+using cight::Frame;
+using cight::RouteFile;
 using clarus::List;
 
 #include <clarus/core/math.hpp>
@@ -30,6 +38,10 @@ using clarus::List;
 #include <clarus/vision/filters.hpp>
 #include <clarus/vision/images.hpp>
 
+#include <boost/bind.hpp>
+
+#include <stdexcept>
+
 #ifdef DIAGNOSTICS
     #include <clarus/core/types.hpp>
     #include <clarus/io/viewer.hpp>
@@ -91,14 +103,32 @@ using clarus::List;
 #endif
 
 StreamTeachV::StreamTeachV():
-    StreamBuffer()
+    StreamBuffer(),
+    levels(0),
+    cursor(0)
 {
     // Nothing to do.
 }
 
-StreamTeachV::StreamTeachV(SensorStream _stream, size_t _size, int padding_b):
+StreamTeachV::StreamTeachV(SensorStream _stream, size_t _size, int padding_b, Comparator comparator):
     StreamBuffer(_stream, _size),
-    padding(padding_b)
+    edges(_size, comparator),
+    padding(padding_b),
+    levels(0),
+    coarse(_size, comparator),
+    cursor(0)
+{
+    // Nothing to do.
+}
+
+StreamTeachV::StreamTeachV(const RouteFile &_route, size_t _size, int padding_b, Comparator comparator):
+    StreamBuffer(SensorStream(), _size),
+    edges(_size, comparator),
+    padding(padding_b),
+    levels(0),
+    coarse(_size, comparator),
+    route(_route),
+    cursor(0)
 {
     // Nothing to do.
 }
@@ -123,71 +153,181 @@ inline cv::Mat preprocess2(const cv::Mat &bgr) {
 
 void StreamTeachV::pop() {
     frames.remove(0);
-    edges.remove(0);
+    edges.pop();
 }
 
-bool StreamTeachV::read() {
-    cv::Mat frame = stream();
+static bool fetchTeach(SensorStream stream, int levels, TeachFrameV &item) {
+    Frame frame(stream());
     if (frame.empty()) {
         return false;
     }
 
-    cv::Mat grays = preprocess2(frame);
-    frames.append(grays);
+    item.gray = frame.gray();
+    item.edges = frame.sobel();
+    if (levels > 0) {
+        item.coarse = frame.level(levels).sobel();
+    }
+
+    return true;
+}
 
-    cv::Mat sobeld = filter::sobel(grays);
-    edges.append(sobeld);
+static bool fetchRoute(const RouteFile &route, size_t k, int levels, TeachFrameV &item) {
+    if (k >= route.size(cight::ROUTE_EDGES)) {
+        return false;
+    }
 
+    if (levels > 0 && route.level() != levels) {
+        throw std::runtime_error("Route file lacks coarse edge maps at the requested pyramid level");
+    }
+
+    item.gray = route.at(cight::ROUTE_GRAY, k);
+    item.edges = route.at(cight::ROUTE_EDGES, k);
+    if (levels > 0) {
+        item.coarse = route.at(cight::ROUTE_COARSE, k);
+    }
+
+    return true;
+}
+
+bool StreamTeachV::read() {
+    TeachFrameV item;
+    if (!route.empty()) {
+        if (!fetchRoute(route, cursor, levels, item)) {
+            return false;
+        }
+
+        cursor++;
+    }
+    else if (!(stage.active() ? stage(item) : fetchTeach(stream, levels, item))) {
+        return false;
+    }
+
+    frames.append(item.gray);
     if (frames.size() > size) {
         pop();
     }
 
+    // Appended after popping, so a full window doesn't lose two frames at once.
+    edges.append(item.edges);
+    if (levels > 0) {
+        coarse.append(item.coarse);
+    }
+
     return true;
 }
 
+void StreamTeachV::resize(size_t size) {
+    StreamBuffer::resize(size);
+    edges.resize(size);
+    coarse.resize(size);
+}
+
+void StreamTeachV::pipeline(size_t depth) {
+    if (!route.empty()) {
+        return;
+    }
+
+    stage = cight::StreamStage<TeachFrameV>(boost::bind(fetchTeach, stream, levels, _1), depth);
+}
+
+size_t StreamTeachV::queued() const {
+    return stage.depth();
+}
+
+void StreamTeachV::seek(size_t k) {
+    if (route.empty()) {
+        throw std::runtime_error("Only teach streams reading from a route can seek");
+    }
+
+    frames = List<cv::Mat>();
+    edges.clear();
+    coarse.clear();
+    cursor = k;
+}
+
 StreamReplayV::StreamReplayV():
-    StreamBuffer()
+    StreamBuffer(),
+    levels(0),
+    exact(false)
 {
     // Nothing to do.
 }
 
 StreamReplayV::StreamReplayV(SensorStream _stream, size_t _size, Selector _selector, int padding_a):
     StreamBuffer(_stream, _size),
+    levels(0),
     selector(_selector),
-    padding(padding_a)
+    padding(padding_a),
+    exact(false)
 {
     // Nothing to do.
 }
 
 List<cv::Mat> StreamReplayV::operator () (int j, StreamTeachV &teach) {
     const FeatureMap &features = maps.at(j);
-    List<cv::Mat> results = features(teach.edges, teach.padding);
+    int shift = tracker.offset();
+    int radius = tracker.radius(teach.padding);
+    List<cv::Mat> results = features(teach.edges, teach.padding, 0, 0, exact, shift, radius);
+    tracker.update(results[2]);
     //shifts.at(j) = results[1];
     return results;
 }
 
+List<List<cv::Mat> > StreamReplayV::operator () (int j0, int j1, StreamTeachV &teach) {
+    int shift = tracker.offset();
+    int radius = tracker.radius(teach.padding);
+    List<List<cv::Mat> > results = cight::evaluateBatch(maps, j0, j1, teach.edges, teach.padding, exact, shift, radius);
+    for (int j = 0, n = results.size(); j < n; j++) {
+        tracker.update(results[j][2]);
+    }
+
+    return results;
+}
+
 void StreamReplayV::pop() {
     frames.remove(0);
     maps.remove(0);
+    if (coarse.size() > 0) {
+        coarse.remove(0);
+    }
+
     //shifts.remove(0);
 }
 
-bool StreamReplayV::read() {
+static bool fetchReplay(SensorStream stream, Selector selector, int padding, int levels, ReplayFrameV &item) {
     for (;;) {
         cv::Mat frame = stream();
         if (frame.empty()) {
             return false;
         }
 
-        cv::Mat grays = preprocess2(frame);
+        // Selectors work on the grayscale image, sharing its derivatives.
+        Frame grays(preprocess2(frame));
 
         FeatureMap features(selector, grays, padding);
         if (features.size() > 0) {
-            maps.append(features);
-            frames.append(grays);
-            break;
+            item.gray = grays.image();
+            item.features = features;
+            if (levels > 0) {
+                item.reduced = features.reduced(grays, levels);
+            }
+
+            return true;
         }
     }
+}
+
+bool StreamReplayV::read() {
+    ReplayFrameV item;
+    if (!(stage.active() ? stage(item) : fetchReplay(stream, selector, padding, levels, item))) {
+        return false;
+    }
+
+    maps.append(item.features);
+    frames.append(item.gray);
+    if (levels > 0) {
+        coarse.append(item.reduced);
+    }
 
     //shifts.append();
 
@@ -198,28 +338,65 @@ bool StreamReplayV::read() {
     return true;
 }
 
+void StreamReplayV::pipeline(size_t depth) {
+    stage = cight::StreamStage<ReplayFrameV>(boost::bind(fetchReplay, stream, selector, padding, levels, _1), depth);
+}
+
+size_t StreamReplayV::queued() const {
+    return stage.depth();
+}
+
 cv::Mat StreamReplayV::shifted(int i, int j) const {
     cv::Mat matrix = shifts.at(i);
     cv::Mat row(matrix, cv::Rect(0, i, matrix.cols, 1));
     return row;
 }
 
-SimilarityMapV::SimilarityMapV() {
+SimilarityMapV::SimilarityMapV():
+    since(0),
+    band(0),
+    radius(-1),
+    predicted(0, 0, 0),
+    confidence(0)
+{
     // Nothing to do.
 }
 
 SimilarityMapV::SimilarityMapV(const cv::Size &size):
-    cv::Mat(size, CV_32F, cv::Scalar(0))
+    cv::Mat(size, CV_32F, cv::Scalar(0)),
+    since(0),
+    band(0),
+    radius(-1),
+    predicted(0, 0, 0),
+    confidence(0)
 {
     // Nothing to do.
 }
 
-bool SimilarityMapV::update(StreamTeachV &teach, StreamReplayV &replay) {
+bool SimilarityMapV::update(StreamTeachV &teach, StreamReplayV &replay, int ahead, const Interpolator &guide) {
     int row0 = teach.frames.size();
-    int col0 = replay.frames.size();
+    int col0 = replay.frames.size() - ahead;
 
     // Shift the similarity matrix to make room for new match estimations
     clarus::shift(*this, row0 - rows, col0 - cols);
+    predicted.x += col0 - cols;
+    predicted.y += row0 - rows;
+
+    // Discard cells of replay frames no longer in the buffer
+    while (cells.size() > (size_t) col0) {
+        cells.remove(0);
+        offsets.remove(0);
+        evaluated.remove(0);
+        searches.remove(0);
+        probes.remove(0);
+    }
+
+    while (roughCells.size() > (size_t) col0) {
+        roughCells.remove(0);
+        roughOffsets.remove(0);
+        roughEvaluated.remove(0);
+        roughSearches.remove(0);
+    }
 
     // Fill teach buffer to capacity
     for (int i = row0; i < rows; i++) {
@@ -228,25 +405,149 @@ bool SimilarityMapV::update(StreamTeachV &teach, StreamReplayV &replay) {
         }
     }
 
-    // Collect replay images, filling the similarity matrix along the way
-    for (int j = col0; j < cols; j++) {
+    // Collect replay images, then fill the similarity matrix in one batch; if the
+    // replay stream runs out, columns for the images read so far are still filled
+    bool complete = true;
+    for (int j = col0 + ahead; j < cols; j++) {
         if (!replay.read()) {
-            return false;
+            complete = false;
+            break;
+        }
+    }
+
+    bool pyramid = (teach.levels > 0 && replay.levels > 0);
+    markProbes(replay.maps.size(), pyramid && !guide.empty());
+
+    std::vector<cv::Range> ranges = bands();
+    if (pyramid) {
+        int padding = std::max(teach.padding >> teach.levels, 1);
+        List<List<cv::Mat> > coarse = cight::evaluateIncremental(replay.coarse, teach.coarse, padding, rows - row0, roughCells, roughOffsets, roughEvaluated, roughSearches);
+        rough = cv::Mat(rows, cols, CV_32F, cv::Scalar(0));
+        for (int j = 0, n = coarse.size(); j < n; j++) {
+            cv::Mat column(rough, cv::Rect(j, 0, 1, rows));
+            coarse[j][0].copyTo(column);
         }
 
-        List<cv::Mat> results = replay(j, teach);
+        // Columns other than probes are narrowed around the coarse line, whether or
+        // not a full resolution line was fitted yet
+        if (!guide.empty()) {
+            cv::Point3f line = guide(rough);
+            double certainty = cight::lineConfidence(rough, line);
+            int coarseRadius = std::max(PYRAMID_BAND_RADIUS, cvRound(band * (1.0 - certainty)));
+
+            ranges.clear();
+            for (int j = 0; j < cols; j++) {
+                if (j < (int) probes.size() && probes[j] != 0) {
+                    ranges.push_back(cv::Range(0, rows));
+                }
+                else {
+                    ranges.push_back(cight::lineBand(line, j, coarseRadius, rows));
+                }
+            }
+        }
+    }
+
+    // New columns are searched around the shift predicted by the tracker, which is
+    // then updated with their displacements
+    int shift = replay.tracker.offset();
+    int searchRadius = replay.tracker.radius(teach.padding);
+    List<List<cv::Mat> > batch = cight::evaluateIncremental(replay.maps, teach.edges, teach.padding, rows - row0, cells, offsets, evaluated, searches, ranges, replay.exact, shift, searchRadius);
+    for (int j = 0, n = batch.size(); j < n; j++) {
+        const List<cv::Mat> &results = batch[j];
         const cv::Mat &responses = results[0];
-        recordResponses(responses);
-        displayMatches(results[1]);
+        if (j >= col0) {
+            replay.tracker.update(results[2]);
+            recordResponses(responses);
+            displayMatches(results[1]);
+        }
+
         cv::Rect roi(j, 0, 1, rows);
         cv::Mat column(*this, roi);
         responses.copyTo(column);
     }
 
-    return true;
+    return complete;
+}
+
+void SimilarityMapV::fit(const cv::Point3f &line) {
+    std::vector<int> columns;
+    for (int j = 0, n = probes.size(); j < n; j++) {
+        if (probes[j] != 0) {
+            columns.push_back(j);
+        }
+    }
+
+    predicted = line;
+    confidence = (columns.empty() ? cight::lineConfidence(*this, line) : cight::lineConfidence(*this, line, columns));
+    radius = std::max(BAND_MIN_RADIUS, cvRound(band * (1.0 - confidence)));
 }
 
-VisualMatcher::VisualMatcher() {
+void SimilarityMapV::markProbes(int columns, bool narrowed) {
+    bool banded = (band > 0 && (radius >= 0 || narrowed));
+    for (int j = probes.size(); j < columns; j++) {
+        bool probe = (!banded || ++since >= std::min(BAND_PROBE_PERIOD, cols));
+        if (probe) {
+            since = 0;
+        }
+
+        probes.append(probe ? 1 : 0);
+    }
+}
+
+std::vector<cv::Range> SimilarityMapV::bands() const {
+    std::vector<cv::Range> ranges;
+    if (band <= 0 || radius < 0) {
+        return ranges;
+    }
+
+    for (int j = 0; j < cols; j++) {
+        if (j < (int) probes.size() && probes[j] != 0) {
+            ranges.push_back(cv::Range(0, rows));
+        }
+        else {
+            ranges.push_back(cight::lineBand(predicted, j, radius, rows));
+        }
+    }
+
+    return ranges;
+}
+
+void SimilarityMapV::resizeWindow(const cv::Size &size) {
+    int dy = size.height - rows;
+    int dx = size.width - cols;
+    if (dy == 0 && dx == 0) {
+        return;
+    }
+
+    cv::Mat::operator = (cight::anchorCorner(*this, size.height, size.width));
+    predicted.x += dx;
+    predicted.y += dy;
+
+    // Coarse cells are cheap to recompute, so they are simply dropped.
+    roughCells = List<cv::Mat>();
+    roughOffsets = List<cv::Mat>();
+    roughEvaluated = List<cv::Mat>();
+    roughSearches = List<cv::Point>();
+
+    while (cells.size() > (size_t) size.width) {
+        cells.remove(0);
+        offsets.remove(0);
+        evaluated.remove(0);
+        searches.remove(0);
+        probes.remove(0);
+    }
+
+    for (int j = 0, n = cells.size(); j < n; j++) {
+        cells[j] = cight::anchorCorner(cells[j], size.height, cells[j].cols);
+        offsets[j] = cight::anchorCorner(offsets[j], size.height, offsets[j].cols);
+        evaluated[j] = cight::anchorCorner(evaluated[j], size.height, evaluated[j].cols);
+    }
+}
+
+VisualMatcher::VisualMatcher():
+    index(-1),
+    provisional(false)
+{
     // Nothing to do.
 }
 
@@ -257,14 +558,45 @@ VisualMatcher::VisualMatcher(
     Selector selector,
     int _padding_a,
     int _padding_b,
-    Interpolator _interpolator
+    Interpolator _interpolator,
+    Comparator comparator
+):
+    teach(teachStream, window.height, _padding_b, comparator),
+    replay(replayStream, window.width, selector, _padding_a),
+    similarities(window),
+    interpolator(_interpolator),
+    line(0, 0, 0),
+    index(-1),
+    provisional(false),
+    dropped(0, 0),
+    latest(-1, -1),
+    windowMin(window),
+    windowMax(window)
+{
+    // Nothing to do.
+}
+
+VisualMatcher::VisualMatcher(
+    const RouteFile &route,
+    SensorStream replayStream,
+    const cv::Size &window,
+    Selector selector,
+    int _padding_a,
+    int _padding_b,
+    Interpolator _interpolator,
+    Comparator comparator
 ):
-    teach(teachStream, window.height, _padding_b),
+    teach(route, window.height, _padding_b, comparator),
     replay(replayStream, window.width, selector, _padding_a),
     similarities(window),
     interpolator(_interpolator),
     line(0, 0, 0),
-    index(-1)
+    index(-1),
+    provisional(false),
+    dropped(0, 0),
+    latest(-1, -1),
+    windowMin(window),
+    windowMax(window)
 {
     // Nothing to do.
 }
@@ -278,24 +610,34 @@ inline float teachIndex(const cv::Point3f &line, float index) {
 #define INDEX_N (similarities.cols - 1)
 
 clarus::List<cv::Mat> VisualMatcher::operator() () {
+    if (provisional) {
+        return extrapolate();
+    }
+
     if (index == -1 && computeMatching() == false) {
         return List<cv::Mat>();
     }
 
     if (index >= similarities.cols) {
+        adapt();
+
         //if (teach.frames.size() - teachIndex(line, INDEX_N) < similarities.rows / 2) {
             teach.pop();
             line.y--;
+            dropped.y++;
         //}
 
         replay.pop();
         line.x--;
+        dropped.x++;
 
+        // Columns still to be filled by the update, usually just the last one.
+        int fresh = similarities.cols - replay.frames.size();
         if (computeMatching() == false) {
             return List<cv::Mat>();
         }
 
-        index = INDEX_N;
+        index = similarities.cols - fresh;
     }
 
     int matched = teachIndex(line, index);
@@ -305,6 +647,7 @@ clarus::List<cv::Mat> VisualMatcher::operator() () {
     frames.append(teach.frames.at(matched));
     //frames.append(replay.shifted(index, matched));
 
+    latest = cv::Point(dropped.x + index, dropped.y + matched);
     index++;
 
     displayImagePairs(frames);
@@ -312,8 +655,156 @@ clarus::List<cv::Mat> VisualMatcher::operator() () {
     return frames;
 }
 
-bool VisualMatcher::computeMatching() {
-    if (similarities.update(teach, replay) == false) {
+List<cv::Mat> VisualMatcher::extrapolate() {
+    // Refit over the frame returned by the previous call before moving on.
+    if (unconfirmed.size() > 0 && replay.frames.size() >= (size_t) similarities.cols && !confirm()) {
+        return List<cv::Mat>();
+    }
+
+    if (index != -1) {
+        teach.pop();
+        line.y--;
+        dropped.y++;
+
+        replay.pop();
+        line.x--;
+        dropped.x++;
+    }
+
+    if (!replay.read()) {
+        return List<cv::Mat>();
+    }
+
+    int j = replay.frames.size() - 1;
+
+    // Before the first fit, assume both streams advance at the same pace.
+    float y = (index == -1 ? j : teachIndex(line, j));
+    int matched = std::max(0, (int) y);
+    while (index == -1 && teach.frames.size() <= (size_t) matched && teach.frames.size() < (size_t) similarities.rows) {
+        if (!teach.read()) {
+            return List<cv::Mat>();
+        }
+    }
+
+    int i = std::min(matched, (int) teach.frames.size() - 1);
+    if (i < 0) {
+        return List<cv::Mat>();
+    }
+
+    List<cv::Mat> frames;
+    frames.append(replay.frames.at(j));
+    frames.append(teach.frames.at(i));
+
+    latest = cv::Point(dropped.x + j, dropped.y + i);
+    unconfirmed.append(latest);
+
+    displayImagePairs(frames);
+
+    return frames;
+}
+
+bool VisualMatcher::confirm() {
+    if (!computeMatching(unconfirmed.size())) {
+        return false;
+    }
+
+    for (int k = 0, n = unconfirmed.size(); k < n; k++) {
+        const cv::Point &match = unconfirmed[k];
+        int matched = std::max(0, (int) teachIndex(line, match.x - dropped.x));
+        int refit = dropped.y + matched;
+        if (refit != match.y) {
+            corrections.append(cv::Point3i(match.x, match.y, refit));
+        }
+    }
+
+    unconfirmed.clear();
+    index = INDEX_N + 1;
+
+    return true;
+}
+
+List<cv::Point3i> VisualMatcher::corrected() {
+    List<cv::Point3i> reported = corrections;
+    corrections = List<cv::Point3i>();
+    return reported;
+}
+
+void VisualMatcher::adapt() {
+    if (windowMin == windowMax) {
+        return;
+    }
+
+    cv::Size size = cight::adaptWindow(line, similarities.confidence, windowMin, windowMax);
+    int dy = std::max((int) teach.frames.size() - size.height, 0);
+    int dx = std::max((int) replay.frames.size() - size.width, 0);
+
+    teach.resize(size.height);
+    replay.resize(size.width);
+    similarities.resizeWindow(size);
+
+    line.x -= dx;
+    line.y -= dy;
+    dropped.x += dx;
+    dropped.y += dy;
+}
+
+void VisualMatcher::coarseToFine(int levels, int band) {
+    if (band <= 0) {
+        throw std::runtime_error("Coarse-to-fine matching requires a positive band");
+    }
+
+    similarities.band = band;
+    teach.levels = levels;
+    replay.levels = levels;
+}
+
+void VisualMatcher::seek(size_t offset) {
+    if (provisional) {
+        throw std::runtime_error("Cannot seek in provisional mode");
+    }
+
+    teach.seek(offset);
+    replay.tracker.reset();
+    similarities.radius = -1;
+    line = cv::Point3f(0, 0, 0);
+    index = -1;
+    dropped.y = offset;
+}
+
+std::vector<int> VisualMatcher::relocalize(const SignatureIndex &signatures, size_t k) {
+    while (replay.frames.size() < (size_t) similarities.cols) {
+        if (!replay.read()) {
+            break;
+        }
+    }
+
+    List<cv::Mat> edges;
+    for (int j = 0, n = replay.frames.size(); j < n; j++) {
+        edges.append(Frame(replay.frames[j]).sobel());
+    }
+
+    std::vector<int> candidates = signatures.nearest(edges, k, similarities.rows);
+    if (!candidates.empty()) {
+        seek(candidates[0]);
+    }
+
+    return candidates;
+}
+
+void VisualMatcher::pipeline(size_t depth) {
+    teach.pipeline(depth);
+    replay.pipeline(depth);
+}
+
+std::vector<size_t> VisualMatcher::queued() const {
+    std::vector<size_t> depths;
+    depths.push_back(teach.queued());
+    depths.push_back(replay.queued());
+    return depths;
+}
+
+bool VisualMatcher::computeMatching(int ahead) {
+    if (similarities.update(teach, replay, ahead, interpolator) == false) {
         return false;
     }
 
@@ -328,6 +819,7 @@ bool VisualMatcher::computeMatching() {
     }
 
     line = line2;
+    similarities.fit(line);
     recordLines(line);
 
     index = line.x;